@@ -0,0 +1,182 @@
+#ifndef convolution_hpp
+#define convolution_hpp
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <limits>
+#include "image.hpp"
+#include "fft.hpp"
+#include "thread_pool.hpp"
+
+/////////////////////////////
+//   Convolution Kernels   //
+/////////////////////////////
+
+// Weights plus the spectra of the kernel zero-padded to every FFT block size it has been used with, so repeated
+// convolutions with the same kernel (every texture in a batch, every frame of a preview) transform it only once.
+class convolution_kernel
+{
+    mutable std::map<int, std::shared_ptr<const std::vector<std::complex<float>>>> spectra;
+    mutable std::mutex mutex;
+
+public:
+
+    image_buffer<float, 1> weights;
+    int2 center; // the weight applied to the output pixel itself
+
+    convolution_kernel(const int2 size) : weights(size), center(size / 2) { std::fill(weights.alias, weights.alias + weights.num_pixels(), 0.f); }
+
+    // Spectrum of the kernel in the top-left corner of a blockSize^2 block of zeros
+    std::shared_ptr<const std::vector<std::complex<float>>> spectrum(const int blockSize) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto & s = spectra[blockSize];
+        if (!s)
+        {
+            auto padded = std::make_shared<std::vector<std::complex<float>>>(size_t(blockSize) * blockSize, 0.f);
+            for (int y = 0; y < weights.size.y; ++y)
+                for (int x = 0; x < weights.size.x; ++x)
+                    (*padded)[size_t(y) * blockSize + x] = weights.alias[y * weights.size.x + x];
+            compute_fft_2d(padded->data(), { blockSize, blockSize }, false, false);
+            s = padded;
+        }
+        return s;
+    }
+};
+
+// Normalized gaussian truncated at 3 sigma
+inline std::shared_ptr<convolution_kernel> make_gaussian_kernel(const float sigma)
+{
+    const int radius = std::max(1, int(std::ceil(3.f * sigma)));
+    auto k = std::make_shared<convolution_kernel>(int2(2 * radius + 1, 2 * radius + 1));
+
+    float sum = 0;
+    for (int y = -radius; y <= radius; ++y)
+        for (int x = -radius; x <= radius; ++x)
+        {
+            const float w = std::exp(-(x * x + y * y) / (2.f * sigma * sigma));
+            k->weights(y + radius, x + radius) = w;
+            sum += w;
+        }
+    for (int i = 0; i < k->weights.num_pixels(); ++i) k->weights.alias[i] /= sum;
+    return k;
+}
+
+/////////////////////
+//   Convolution   //
+/////////////////////
+
+// Straightforward 2D convolution, edges clamped. Rows in parallel.
+inline image_buffer<float, 1> convolve_direct(image_buffer<float, 1> & img, const convolution_kernel & k)
+{
+    const int width = img.size.x, height = img.size.y;
+    const int kw = k.weights.size.x, kh = k.weights.size.y;
+    image_buffer<float, 1> out(img.size);
+
+    parallel_for(0, height, 16, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                float sum = 0;
+                for (int a = 0; a < kh; ++a)
+                {
+                    const int sy = clamp(y + k.center.y - a, 0, height - 1);
+                    for (int b = 0; b < kw; ++b) sum += k.weights.alias[a * kw + b] * img(sy, clamp(x + k.center.x - b, 0, width - 1));
+                }
+                out(y, x) = sum;
+            }
+    });
+    return out;
+}
+
+// Estimated cost of overlap-save over the whole image with blocks of blockSize: two transforms per block
+// (~ 5 N log2 N flops each for kissfft) plus the spectrum multiply, times the number of blocks needed.
+inline double fft_convolution_cost(const int2 imageSize, const int2 kernelSize, const int blockSize)
+{
+    const int validX = blockSize - kernelSize.x + 1, validY = blockSize - kernelSize.y + 1;
+    if (validX <= 0 || validY <= 0) return std::numeric_limits<double>::max();
+    const double n = double(blockSize) * blockSize;
+    const double blocks = double((imageSize.x + validX - 1) / validX) * ((imageSize.y + validY - 1) / validY);
+    return blocks * (2 * 5 * n * std::log2(n) + 6 * n);
+}
+
+// Direct convolution with clamped edges measures at about three flops of the FFT path per multiply-add
+inline double direct_convolution_cost(const int2 imageSize, const int2 kernelSize)
+{
+    return 3.0 * imageSize.x * imageSize.y * kernelSize.x * kernelSize.y;
+}
+
+// Cheapest power-of-two block, at least twice the kernel and no bigger than needed to cover the image in one block
+inline int choose_fft_block_size(const int2 imageSize, const int2 kernelSize)
+{
+    int best = 0;
+    double bestCost = std::numeric_limits<double>::max();
+    const int largest = std::max(imageSize.x, imageSize.y) + std::max(kernelSize.x, kernelSize.y);
+    for (int b = 16; b <= 4096; b *= 2)
+    {
+        if (b < 2 * std::max(kernelSize.x, kernelSize.y)) continue;
+        const double cost = fft_convolution_cost(imageSize, kernelSize, b);
+        if (cost < bestCost) { bestCost = cost; best = b; }
+        if (b >= largest) break;
+    }
+    return best;
+}
+
+// Overlap-save: the output is cut into tiles of blockSize - kernel + 1, each computed independently from its
+// clamped input neighbourhood by one forward transform, a multiply by the cached kernel spectrum and one inverse,
+// keeping only the part of the circular result that didn't wrap. Tiles never overlap in the output, so they run
+// as parallel jobs with no locking, each holding one block-sized buffer.
+inline image_buffer<float, 1> convolve_fft(image_buffer<float, 1> & img, const convolution_kernel & k, int blockSize = 0)
+{
+    const int width = img.size.x, height = img.size.y;
+    const int kw = k.weights.size.x, kh = k.weights.size.y;
+    if (blockSize == 0) blockSize = choose_fft_block_size(img.size, k.weights.size);
+
+    const int validX = blockSize - kw + 1, validY = blockSize - kh + 1;
+    const int tilesX = (width + validX - 1) / validX, tilesY = (height + validY - 1) / validY;
+    const float scale = 1.f / (float(blockSize) * blockSize);
+
+    auto kernelSpectrum = k.spectrum(blockSize);
+    image_buffer<float, 1> out(img.size);
+
+    parallel_for(0, tilesX * tilesY, 1, [&](int t0, int t1)
+    {
+        std::vector<std::complex<float>> block(size_t(blockSize) * blockSize);
+
+        for (int t = t0; t < t1; ++t)
+        {
+            const int ox = (t % tilesX) * validX, oy = (t / tilesX) * validY;
+            const int sx = ox + k.center.x - (kw - 1), sy = oy + k.center.y - (kh - 1);
+
+            for (int y = 0; y < blockSize; ++y)
+            {
+                const float * row = &img(clamp(sy + y, 0, height - 1), 0);
+                for (int x = 0; x < blockSize; ++x) block[size_t(y) * blockSize + x] = row[clamp(sx + x, 0, width - 1)];
+            }
+
+            compute_fft_2d(block.data(), { blockSize, blockSize }, false, false);
+            for (size_t i = 0; i < block.size(); ++i) block[i] *= (*kernelSpectrum)[i];
+            compute_fft_2d(block.data(), { blockSize, blockSize }, true, false);
+
+            for (int y = 0; y < validY && oy + y < height; ++y)
+                for (int x = 0; x < validX && ox + x < width; ++x)
+                    out(oy + y, ox + x) = block[size_t(y + kh - 1) * blockSize + x + kw - 1].real() * scale;
+        }
+    });
+    return out;
+}
+
+// Picks direct or FFT convolution, whichever is estimated to be cheaper for this image and kernel
+inline image_buffer<float, 1> convolve(image_buffer<float, 1> & img, const convolution_kernel & k)
+{
+    const int blockSize = choose_fft_block_size(img.size, k.weights.size);
+    if (blockSize == 0 || direct_convolution_cost(img.size, k.weights.size) <= fft_convolution_cost(img.size, k.weights.size, blockSize)) return convolve_direct(img, k);
+    return convolve_fft(img, k, blockSize);
+}
+
+#endif // end convolution_hpp
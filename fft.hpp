@@ -0,0 +1,463 @@
+#ifndef fft_hpp
+#define fft_hpp
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <complex>
+#include <functional>
+#include <exception>
+#include <cassert>
+#include <string>
+#include <stdexcept>
+#include "util.hpp"
+#include "image.hpp"
+#include "thread_pool.hpp"
+#include "kissfft/kissfft.hpp"
+#include "fft_codelets.hpp"
+
+///////////////////
+//   Windowing   //
+///////////////////
+
+enum class window_type { none, hann, blackman, kaiser, tukey };
+
+inline const char * window_name(const window_type w)
+{
+    switch (w)
+    {
+    case window_type::hann: return "hann";
+    case window_type::blackman: return "blackman";
+    case window_type::kaiser: return "kaiser";
+    case window_type::tukey: return "tukey";
+    default: return "none";
+    }
+}
+
+inline window_type window_from_name(const std::string & name)
+{
+    for (auto w : { window_type::none, window_type::hann, window_type::blackman, window_type::kaiser, window_type::tukey })
+    {
+        if (name == window_name(w)) return w;
+    }
+    throw std::runtime_error("unknown window " + name);
+}
+
+// Zeroth order modified Bessel function of the first kind, by its power series
+inline double bessel_i0(const double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Periodic (DFT-even) window of length n, scaled to a mean square of one so that windowing preserves the
+// expected power of stationary content and spectra stay comparable across window types.
+// Kaiser uses beta = 8.6 (close to Blackman), Tukey a cosine taper over half the length.
+inline std::vector<float> make_window(const window_type type, const int n)
+{
+    const double pi = 3.14159265358979323846;
+    std::vector<double> w(n, 1.0);
+    for (int i = 0; i < n; ++i)
+    {
+        const double t = double(i) / n;
+        switch (type)
+        {
+        case window_type::hann: w[i] = 0.5 - 0.5 * std::cos(2 * pi * t); break;
+        case window_type::blackman: w[i] = 0.42 - 0.5 * std::cos(2 * pi * t) + 0.08 * std::cos(4 * pi * t); break;
+        case window_type::kaiser: { const double r = 2 * t - 1, beta = 8.6; w[i] = bessel_i0(beta * std::sqrt(std::max(0.0, 1 - r * r))) / bessel_i0(beta); break; }
+        case window_type::tukey: { const double alpha = 0.5, d = std::min(t, 1 - t); w[i] = d < alpha / 2 ? 0.5 - 0.5 * std::cos(2 * pi * d / alpha) : 1.0; break; }
+        default: break;
+        }
+    }
+
+    double meanSquare = 0;
+    for (auto v : w) meanSquare += v * v;
+    const double scale = 1.0 / std::sqrt(std::max(meanSquare / n, 1e-30));
+
+    std::vector<float> result(n);
+    for (int i = 0; i < n; ++i) result[i] = float(w[i] * scale);
+    return result;
+}
+
+////////////////////////
+//   FFT Plan Cache   //
+////////////////////////
+
+typedef kissfft<float>::twiddle_table fft_twiddle_table;
+
+// Per-thread transform buffers, grown to the largest size seen and then reused, so batched transforms neither
+// allocate nor zero-fill once a thread has run its first one
+struct fft_scratch
+{
+    std::vector<fft_batch_sample> in, out;
+    std::vector<std::complex<float>> row, slab;
+
+    template <typename T> static T * reserve(std::vector<T> & v, const size_t count)
+    {
+        if (v.size() < count) v.resize(count);
+        return v.data();
+    }
+};
+
+inline fft_scratch & get_fft_scratch()
+{
+    static thread_local fft_scratch scratch;
+    return scratch;
+}
+
+// One 1D transform of a given size and direction: a compile-time codelet for the common texture sizes,
+// a kissfft plan for everything else. Either way transform() is const and thread-safe. kissfft plans read
+// a forward twiddle table that the inverse plan of the same size shares, conjugating on the fly.
+class fft_plan
+{
+    int n;
+    fft_codelet_fn codelet;
+    fft_batch_codelet_fn batchCodelet;
+    std::unique_ptr<const kissfft<float>> fallback;
+public:
+    fft_plan(const int n, const bool inverse, const std::function<std::shared_ptr<const fft_twiddle_table>()> & twiddles)
+        : n(n), codelet(find_fft_codelet(n, inverse)), batchCodelet(find_fft_batch_codelet(n, inverse))
+    {
+        if (!codelet) fallback.reset(new kissfft<float>(twiddles(), inverse));
+    }
+
+    void transform(const std::complex<float> * src, std::complex<float> * dst) const
+    {
+        if (codelet) codelet(src, dst);
+        else fallback->transform(src, dst);
+    }
+
+    // count transforms in place, element t of row r at data[r * rowStride + t * elementStride]. For the codelet sizes,
+    // groups of fft_batch_lanes rows are transposed into one split-complex buffer and transformed together, a row per
+    // SIMD lane. Leftover rows, and every other size, are transformed one at a time, strided ones from a slab.
+    void transform_batch(std::complex<float> * data, const int count, const size_t rowStride, const size_t elementStride = 1) const
+    {
+        fft_scratch & scratch = get_fft_scratch();
+        int r = 0;
+        if (batchCodelet && count >= fft_batch_lanes)
+        {
+            fft_batch_sample * in = fft_scratch::reserve(scratch.in, n);
+            fft_batch_sample * out = fft_scratch::reserve(scratch.out, n);
+            for (; r + fft_batch_lanes <= count; r += fft_batch_lanes)
+            {
+                std::complex<float> * rows = data + r * rowStride;
+
+                // Walk whichever stride is contiguous in the inner loop
+                if (elementStride == 1)
+                {
+                    for (int l = 0; l < fft_batch_lanes; ++l)
+                        for (int t = 0; t < n; ++t) { in[t].re[l] = rows[l * rowStride + t].real(); in[t].im[l] = rows[l * rowStride + t].imag(); }
+                }
+                else
+                {
+                    for (int t = 0; t < n; ++t)
+                        for (int l = 0; l < fft_batch_lanes; ++l) { in[t].re[l] = rows[l * rowStride + t * elementStride].real(); in[t].im[l] = rows[l * rowStride + t * elementStride].imag(); }
+                }
+
+                batchCodelet(in, out);
+
+                if (elementStride == 1)
+                {
+                    for (int l = 0; l < fft_batch_lanes; ++l)
+                        for (int t = 0; t < n; ++t) rows[l * rowStride + t] = { out[t].re[l], out[t].im[l] };
+                }
+                else
+                {
+                    for (int t = 0; t < n; ++t)
+                        for (int l = 0; l < fft_batch_lanes; ++l) rows[l * rowStride + t * elementStride] = { out[t].re[l], out[t].im[l] };
+                }
+            }
+        }
+
+        if (r == count) return;
+        std::complex<float> * dst = fft_scratch::reserve(scratch.row, n);
+        if (elementStride == 1)
+        {
+            for (; r < count; ++r)
+            {
+                std::complex<float> * row = data + r * rowStride;
+                transform(row, dst);
+                std::copy(dst, dst + n, row);
+            }
+            return;
+        }
+
+        // Strided rows (columns, the z axis) are gathered in blocks of adjacent rows into a transposed slab, so each
+        // element t is read as one contiguous run of the block instead of one cache line per row
+        const int blockRows = 16; // 16 complex floats = two cache lines per element
+        std::complex<float> * slab = fft_scratch::reserve(scratch.slab, size_t(blockRows) * n);
+        for (; r < count; r += blockRows)
+        {
+            std::complex<float> * rows = data + r * rowStride;
+            const int bw = std::min(blockRows, count - r);
+
+            for (int t = 0; t < n; ++t)
+                for (int b = 0; b < bw; ++b) slab[size_t(b) * n + t] = rows[b * rowStride + t * elementStride];
+
+            for (int b = 0; b < bw; ++b)
+            {
+                transform(slab + size_t(b) * n, dst);
+                std::copy(dst, dst + n, slab + size_t(b) * n);
+            }
+
+            for (int t = 0; t < n; ++t)
+                for (int b = 0; b < bw; ++b) rows[b * rowStride + t * elementStride] = slab[size_t(b) * n + t];
+        }
+    }
+};
+
+// Plans are immutable after construction, so a single plan per (size, direction) is shared between every
+// thread and every caller, and a single twiddle table per size between both directions. 1D window
+// coefficients are cached alongside, per (window, length): a 2D window is the outer product of two.
+class fft_plan_cache
+{
+    std::map<std::pair<int, bool>, std::shared_ptr<const fft_plan>> plans;
+    std::map<int, std::shared_ptr<const fft_twiddle_table>> twiddles;
+    std::map<std::pair<window_type, int>, std::shared_ptr<const std::vector<float>>> windows;
+    std::mutex mutex;
+
+    // Caller holds the mutex
+    std::shared_ptr<const fft_twiddle_table> find_twiddles(const int n)
+    {
+        auto & table = twiddles[n];
+        if (!table) table = kissfft<float>::make_twiddles(n);
+        return table;
+    }
+public:
+    std::shared_ptr<const fft_plan> get(const int n, const bool inverse)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto & plan = plans[{ n, inverse }];
+        if (!plan) plan = std::make_shared<const fft_plan>(n, inverse, [&]() { return find_twiddles(n); });
+        return plan;
+    }
+    // Forward twiddles exp(-2 pi i k / n), the same table the plans of size n use
+    std::shared_ptr<const fft_twiddle_table> get_twiddles(const int n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return find_twiddles(n);
+    }
+    std::shared_ptr<const std::vector<float>> get_window(const window_type type, const int n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto & window = windows[{ type, n }];
+        if (!window) window = std::make_shared<const std::vector<float>>(make_window(type, n));
+        return window;
+    }
+    void clear() { std::lock_guard<std::mutex> lock(mutex); plans.clear(); twiddles.clear(); windows.clear(); }
+};
+
+inline fft_plan_cache & get_fft_plan_cache()
+{
+    static fft_plan_cache cache;
+    return cache;
+}
+
+//////////////////////
+//   2D Transform   //
+//////////////////////
+
+// In place. Rows, then columns, each pass spread across the shared thread pool unless the caller is already
+// running many small transforms as separate jobs and asks for it to stay on the calling thread.
+inline void compute_fft_2d(std::complex<float> * data, const int2 & size, const bool inverse = false, const bool parallel = true)
+{
+    const int width = size.x;
+    const int height = size.y;
+
+    auto xFFT = get_fft_plan_cache().get(width, inverse);
+    auto yFFT = get_fft_plan_cache().get(height, inverse);
+
+    // Only the parallel path wraps fn in a std::function, so serial transforms don't allocate
+    auto run = [parallel](int n, const auto & fn)
+    {
+        if (parallel) parallel_for(0, n, 16, fn);
+        else fn(0, n);
+    };
+
+    // Compute FFT on X axis
+    run(height, [&](int y0, int y1)
+    {
+        xFFT->transform_batch(&data[size_t(y0) * width], y1 - y0, width);
+    });
+
+    // Compute FFT on Y axis: adjacent columns are adjacent in memory, so each batch gathers whole cache lines
+    run(width, [&](int x0, int x1)
+    {
+        yFFT->transform_batch(&data[x0], x1 - x0, 1, width);
+    });
+}
+
+//////////////////////
+//   3D Transform   //
+//////////////////////
+
+// In place. Each z slice goes through the 2D row/column passes, then the strided z axis is transformed in batches
+// of adjacent x columns for a fixed y, like the y axis of the 2D transform: either across SIMD lanes or, for sizes
+// without a codelet, through a transposed slab (contiguous reads per z either way).
+inline void compute_fft_3d(std::complex<float> * data, const int3 & size, const bool inverse = false)
+{
+    const int width = size.x, height = size.y, depth = size.z;
+    const size_t sliceSize = size_t(width) * height;
+
+    parallel_for(0, depth, 1, [&](int z0, int z1)
+    {
+        for (int z = z0; z < z1; ++z) compute_fft_2d(data + z * sliceSize, { width, height }, inverse);
+    });
+
+    if (depth == 1) return;
+
+    auto zFFT = get_fft_plan_cache().get(depth, inverse);
+
+    parallel_for(0, height, 1, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y) zFFT->transform_batch(data + size_t(y) * width, width, 1, sliceSize);
+    });
+}
+
+// Mean-subtracted, optionally windowed forward transform of a luminance image. The separable window is applied
+// in the same loop that converts to complex, from the cached 1D tables: no transcendentals per pixel.
+// With a window, the window-weighted mean is subtracted so that no DC leaks into the neighbouring bins.
+inline std::vector<std::complex<float>> compute_spectrum(image_buffer<float, 1> & img, const window_type window = window_type::none)
+{
+    const int width = img.size.x, height = img.size.y;
+    std::vector<std::complex<float>> spectrum(img.num_pixels());
+
+    if (window == window_type::none)
+    {
+        const float mean = img.compute_mean();
+        for (int i = 0; i < img.num_pixels(); ++i) spectrum[i] = img.alias[i] - mean;
+    }
+    else
+    {
+        auto wx = get_fft_plan_cache().get_window(window, width);
+        auto wy = get_fft_plan_cache().get_window(window, height);
+
+        double columnWeight = 0, rowWeight = 0;
+        for (float w : *wx) columnWeight += w;
+        for (float w : *wy) rowWeight += w;
+        const float mean = float(windowed_mean(img.view(), wx->data(), wy->data(), columnWeight * rowWeight));
+
+        parallel_for(0, height, 64, [&](int y0, int y1)
+        {
+            const float * columnWindow = wx->data();
+            for (int y = y0; y < y1; ++y)
+            {
+                const float rowWindow = (*wy)[y];
+                const float * src = &img(y, 0);
+                float * dst = reinterpret_cast<float *>(&spectrum[size_t(y) * width]); // complex<float> is two packed floats
+                for (int x = 0; x < width; ++x)
+                {
+                    dst[2 * x] = (src[x] - mean) * columnWindow[x] * rowWindow;
+                    dst[2 * x + 1] = 0.f;
+                }
+            }
+        });
+    }
+
+    compute_fft_2d(spectrum.data(), img.size);
+    return spectrum;
+}
+
+// Same result as compute_spectrum(img) with no window, for rows that arrive one at a time from a streaming decoder.
+// produceRow(y, row) fills img row by row on the calling thread, and each batch of decoded rows is handed to the
+// pool to transform while decoding continues, so only the column pass waits for the last row. The mean isn't known
+// until the end, so the mean of the first batch is subtracted instead (keeping the large DC out of the row
+// transforms) and the DC is cleared afterwards. A decode error cancels the batches that haven't started.
+inline std::vector<std::complex<float>> compute_spectrum_streaming(image_buffer<float, 1> & img, const std::function<void(int, float *)> & produceRow)
+{
+    const int width = img.size.x, height = img.size.y;
+    thread_pool & pool = get_thread_pool();
+    const int batch = std::max(64, 16 * (int)pool.num_threads());
+    std::vector<std::complex<float>> spectrum(img.num_pixels());
+    auto xFFT = get_fft_plan_cache().get(width, false);
+    auto yFFT = get_fft_plan_cache().get(height, false);
+
+    float offset = 0;
+    cancellation_token cancel;
+    std::vector<thread_pool::task> rowBatches;
+
+    auto transform_rows = [&](const int first, const int last)
+    {
+        pool.parallel_for(first, last, 16, [&](int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                const float * src = &img(y, 0);
+                std::complex<float> * dst = &spectrum[size_t(y) * width];
+                for (int x = 0; x < width; ++x) dst[x] = src[x] - offset;
+            }
+            xFFT->transform_batch(&spectrum[size_t(y0) * width], y1 - y0, width);
+        }, cancel);
+    };
+
+    std::exception_ptr error;
+    try
+    {
+        for (int done = 0, y = 0; y < height; ++y)
+        {
+            produceRow(y, &img(y, 0));
+            if (y + 1 - done < batch && y + 1 < height) continue;
+
+            if (done == 0) offset = float(reduce_samples(img.alias, size_t(y + 1) * width).mean);
+            rowBatches.push_back(pool.async(std::bind(transform_rows, done, y + 1)));
+            done = y + 1;
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+        cancel.cancel();
+    }
+
+    // Every batch is waited for, even after an error, since they all refer to the locals here
+    for (auto & t : rowBatches)
+    {
+        try { t.wait(); }
+        catch (...)
+        {
+            if (!error) error = std::current_exception();
+            cancel.cancel();
+        }
+    }
+    if (error) std::rethrow_exception(error);
+
+    parallel_for(0, width, 16, [&](int x0, int x1)
+    {
+        yFFT->transform_batch(&spectrum[x0], x1 - x0, 1, width);
+    });
+    spectrum[0] = 0;
+    return spectrum;
+}
+
+inline void center_fft_image(image_buffer<float, 1> & in, image_buffer<float, 1> & out)
+{
+    assert(in.size == out.size);
+
+    const int halfWidth = in.size.x / 2;
+    const int halfHeight = in.size.y / 2;
+
+    for (int i = 0; i < in.size.y; i++)
+    {
+        for (int j = 0; j < in.size.x; j++)
+        {
+            if (i < halfHeight)
+            {
+                if (j < halfWidth) out(i, j) = in(i + halfHeight, j + halfWidth);
+                else out(i, j) = in(i + halfHeight, j - halfWidth);
+            }
+            else
+            {
+                if (j < halfWidth) out(i, j) = in(i - halfHeight, j + halfWidth);
+                else out(i, j) = in(i - halfHeight, j - halfWidth);
+            }
+        }
+    }
+}
+
+#endif // end fft_hpp
@@ -0,0 +1,292 @@
+#ifndef fft_codelets_hpp
+#define fft_codelets_hpp
+
+#include <complex>
+#include <utility>
+#include <cstddef>
+
+///////////////////////////////
+//   Compile-Time Twiddles   //
+///////////////////////////////
+
+// C++11 constexpr (single return statement) so that VS2015 evaluates the tables at compile time. The series are
+// summed in double from an angle already reduced to [-pi, pi], where 24 terms are exact to double precision.
+
+constexpr double codelet_pi = 3.14159265358979323846;
+
+constexpr double constexpr_sin_series(const double x2, const double term, const int n, const int terms)
+{
+    return terms == 0 ? 0.0 : term + constexpr_sin_series(x2, -term * x2 / ((2 * n + 2) * (2 * n + 3)), n + 1, terms - 1);
+}
+
+constexpr double constexpr_cos_series(const double x2, const double term, const int n, const int terms)
+{
+    return terms == 0 ? 0.0 : term + constexpr_cos_series(x2, -term * x2 / ((2 * n + 1) * (2 * n + 2)), n + 1, terms - 1);
+}
+
+constexpr double constexpr_sin(const double x) { return constexpr_sin_series(x * x, x, 0, 24); }
+constexpr double constexpr_cos(const double x) { return constexpr_cos_series(x * x, 1.0, 0, 24); }
+
+struct codelet_twiddle { float re, im; };
+
+// exp(-2 pi i k / n), with k taken to the signed index in (-n/2, n/2] first so the series stays on [-pi, pi]
+constexpr codelet_twiddle make_codelet_twiddle(const int k, const int n)
+{
+    return { float(constexpr_cos(2 * codelet_pi * (k <= n / 2 ? k : k - n) / n)), float(-constexpr_sin(2 * codelet_pi * (k <= n / 2 ? k : k - n) / n)) };
+}
+
+template <int N, typename Indices = std::make_index_sequence<N>> struct codelet_twiddle_table;
+
+template <int N, size_t... I> struct codelet_twiddle_table<N, std::index_sequence<I...>>
+{
+    static constexpr codelet_twiddle values[N] = { make_codelet_twiddle(int(I), N)... };
+};
+
+template <int N, size_t... I> constexpr codelet_twiddle codelet_twiddle_table<N, std::index_sequence<I...>>::values[N];
+
+//////////////////////
+//   FFT Codelets   //
+//////////////////////
+
+// Power-of-two transforms with the length as a template parameter: radix-4 decimation in time down to fully unrolled
+// 4- or 8-point leaves, same ordering and scaling as kissfft (unnormalized, inverse = positive exponent). M is the
+// length of the top-level transform, whose twiddle table every stage reads with a stride of M / N, which is also
+// the input stride of the sub-transform. All trip counts and strides are constants; the twiddles live in rodata.
+
+template <bool Inverse>
+inline std::complex<float> codelet_rotate(const std::complex<float> a, const codelet_twiddle w)
+{
+    const float wi = Inverse ? -w.im : w.im;
+    return { a.real() * w.re - a.imag() * wi, a.real() * wi + a.imag() * w.re };
+}
+
+// Multiplication by -i for the forward transform, +i for the inverse
+template <bool Inverse>
+inline std::complex<float> codelet_quarter_turn(const std::complex<float> a)
+{
+    return Inverse ? std::complex<float>(-a.imag(), a.real()) : std::complex<float>(a.imag(), -a.real());
+}
+
+template <int N, int M, bool Inverse>
+struct fft_codelet
+{
+    static_assert((N & (N - 1)) == 0 && N >= 16, "the general codelet takes powers of two of at least 16; 4 and 8 are specialized");
+
+    static void run(const std::complex<float> * in, std::complex<float> * out)
+    {
+        const int quarter = N / 4, stride = M / N;
+        const codelet_twiddle * twiddles = codelet_twiddle_table<M>::values;
+
+        for (int q = 0; q < 4; ++q) fft_codelet<quarter, M, Inverse>::run(in + q * stride, out + q * quarter);
+
+        for (int k = 0; k < quarter; ++k)
+        {
+            const std::complex<float> a0 = out[k];
+            const std::complex<float> a1 = codelet_rotate<Inverse>(out[k + quarter], twiddles[k * stride]);
+            const std::complex<float> a2 = codelet_rotate<Inverse>(out[k + 2 * quarter], twiddles[2 * k * stride]);
+            const std::complex<float> a3 = codelet_rotate<Inverse>(out[k + 3 * quarter], twiddles[3 * k * stride]);
+
+            const std::complex<float> s02 = a0 + a2, d02 = a0 - a2;
+            const std::complex<float> s13 = a1 + a3, d13 = codelet_quarter_turn<Inverse>(a1 - a3);
+
+            out[k] = s02 + s13;
+            out[k + quarter] = d02 + d13;
+            out[k + 2 * quarter] = s02 - s13;
+            out[k + 3 * quarter] = d02 - d13;
+        }
+    }
+};
+
+template <int M, bool Inverse>
+struct fft_codelet<4, M, Inverse>
+{
+    static void run(const std::complex<float> * in, std::complex<float> * out)
+    {
+        const int stride = M / 4;
+        const std::complex<float> s02 = in[0] + in[2 * stride], d02 = in[0] - in[2 * stride];
+        const std::complex<float> s13 = in[stride] + in[3 * stride], d13 = codelet_quarter_turn<Inverse>(in[stride] - in[3 * stride]);
+        out[0] = s02 + s13;
+        out[1] = d02 + d13;
+        out[2] = s02 - s13;
+        out[3] = d02 - d13;
+    }
+};
+
+template <int M, bool Inverse>
+struct fft_codelet<8, M, Inverse>
+{
+    static void run(const std::complex<float> * in, std::complex<float> * out)
+    {
+        const int stride = M / 8;
+        const float h = 0.70710678118654752f;
+
+        // Two 4-point transforms of the even and odd samples
+        const std::complex<float> e02 = in[0] + in[4 * stride], e02d = in[0] - in[4 * stride];
+        const std::complex<float> e13 = in[2 * stride] + in[6 * stride], e13d = codelet_quarter_turn<Inverse>(in[2 * stride] - in[6 * stride]);
+        const std::complex<float> o02 = in[stride] + in[5 * stride], o02d = in[stride] - in[5 * stride];
+        const std::complex<float> o13 = in[3 * stride] + in[7 * stride], o13d = codelet_quarter_turn<Inverse>(in[3 * stride] - in[7 * stride]);
+
+        const std::complex<float> e0 = e02 + e13, e1 = e02d + e13d, e2 = e02 - e13, e3 = e02d - e13d;
+        const std::complex<float> o0 = o02 + o13, o1 = o02d + o13d, o2 = o02 - o13, o3 = o02d - o13d;
+
+        // Odd half times exp(-+ 2 pi i k / 8): 1, (1 -+ i) / sqrt2, -+i, (-1 -+ i) / sqrt2
+        const std::complex<float> t0 = o0;
+        const std::complex<float> t1 = (o1 + codelet_quarter_turn<Inverse>(o1)) * h;
+        const std::complex<float> t2 = codelet_quarter_turn<Inverse>(o2);
+        const std::complex<float> t3 = (codelet_quarter_turn<Inverse>(o3) - o3) * h;
+
+        out[0] = e0 + t0; out[4] = e0 - t0;
+        out[1] = e1 + t1; out[5] = e1 - t1;
+        out[2] = e2 + t2; out[6] = e2 - t2;
+        out[3] = e3 + t3; out[7] = e3 - t3;
+    }
+};
+
+template <int N, bool Inverse>
+inline void run_fft_codelet(const std::complex<float> * in, std::complex<float> * out)
+{
+    fft_codelet<N, N, Inverse>::run(in, out);
+}
+
+typedef void (*fft_codelet_fn)(const std::complex<float> *, std::complex<float> *);
+
+// The sizes almost every texture comes in; anything else goes through kissfft
+inline fft_codelet_fn find_fft_codelet(const int n, const bool inverse)
+{
+    switch (n)
+    {
+    case 256: return inverse ? &run_fft_codelet<256, true> : &run_fft_codelet<256, false>;
+    case 512: return inverse ? &run_fft_codelet<512, true> : &run_fft_codelet<512, false>;
+    case 1024: return inverse ? &run_fft_codelet<1024, true> : &run_fft_codelet<1024, false>;
+    case 2048: return inverse ? &run_fft_codelet<2048, true> : &run_fft_codelet<2048, false>;
+    case 4096: return inverse ? &run_fft_codelet<4096, true> : &run_fft_codelet<4096, false>;
+    default: return nullptr;
+    }
+}
+
+/////////////////////////////
+//   Batched FFT Codelets   //
+/////////////////////////////
+
+// The same transforms over fft_batch_lanes independent rows at once. Samples are stored split-complex with the rows
+// interleaved, so each sample is one SIMD register of reals and one of imaginaries, one lane per row: the
+// butterflies are the scalar ones applied lane-wise, with no shuffles, and the fixed-count lane loops vectorize.
+
+const int fft_batch_lanes = 8;
+
+struct fft_batch_sample
+{
+    float re[fft_batch_lanes];
+    float im[fft_batch_lanes];
+};
+
+// Radix-4 butterfly across all lanes, the three inputs after the first rotated by w1, w2, w3
+template <bool Inverse>
+inline void batch_butterfly4(fft_batch_sample & x0, fft_batch_sample & x1, fft_batch_sample & x2, fft_batch_sample & x3,
+    const codelet_twiddle w1, const codelet_twiddle w2, const codelet_twiddle w3)
+{
+    const float w1i = Inverse ? -w1.im : w1.im, w2i = Inverse ? -w2.im : w2.im, w3i = Inverse ? -w3.im : w3.im;
+    for (int l = 0; l < fft_batch_lanes; ++l)
+    {
+        const float a0r = x0.re[l], a0i = x0.im[l];
+        const float a1r = x1.re[l] * w1.re - x1.im[l] * w1i, a1i = x1.re[l] * w1i + x1.im[l] * w1.re;
+        const float a2r = x2.re[l] * w2.re - x2.im[l] * w2i, a2i = x2.re[l] * w2i + x2.im[l] * w2.re;
+        const float a3r = x3.re[l] * w3.re - x3.im[l] * w3i, a3i = x3.re[l] * w3i + x3.im[l] * w3.re;
+
+        const float s02r = a0r + a2r, s02i = a0i + a2i, d02r = a0r - a2r, d02i = a0i - a2i;
+        const float s13r = a1r + a3r, s13i = a1i + a3i;
+        const float d13r = Inverse ? a3i - a1i : a1i - a3i, d13i = Inverse ? a1r - a3r : a3r - a1r; // -+i (a1 - a3)
+
+        x0.re[l] = s02r + s13r; x0.im[l] = s02i + s13i;
+        x1.re[l] = d02r + d13r; x1.im[l] = d02i + d13i;
+        x2.re[l] = s02r - s13r; x2.im[l] = s02i - s13i;
+        x3.re[l] = d02r - d13r; x3.im[l] = d02i - d13i;
+    }
+}
+
+template <int N, int M, bool Inverse>
+struct fft_batch_codelet
+{
+    static_assert((N & (N - 1)) == 0 && N >= 16, "the general codelet takes powers of two of at least 16; 4 and 8 are specialized");
+
+    static void run(const fft_batch_sample * in, fft_batch_sample * out)
+    {
+        const int quarter = N / 4, stride = M / N;
+        const codelet_twiddle * twiddles = codelet_twiddle_table<M>::values;
+
+        for (int q = 0; q < 4; ++q) fft_batch_codelet<quarter, M, Inverse>::run(in + q * stride, out + q * quarter);
+
+        for (int k = 0; k < quarter; ++k)
+        {
+            batch_butterfly4<Inverse>(out[k], out[k + quarter], out[k + 2 * quarter], out[k + 3 * quarter],
+                twiddles[k * stride], twiddles[2 * k * stride], twiddles[3 * k * stride]);
+        }
+    }
+};
+
+template <int M, bool Inverse>
+struct fft_batch_codelet<4, M, Inverse>
+{
+    static void run(const fft_batch_sample * in, fft_batch_sample * out)
+    {
+        const int stride = M / 4;
+        const codelet_twiddle one = { 1.f, 0.f };
+        out[0] = in[0]; out[1] = in[stride]; out[2] = in[2 * stride]; out[3] = in[3 * stride];
+        batch_butterfly4<Inverse>(out[0], out[1], out[2], out[3], one, one, one);
+    }
+};
+
+template <int M, bool Inverse>
+struct fft_batch_codelet<8, M, Inverse>
+{
+    static void run(const fft_batch_sample * in, fft_batch_sample * out)
+    {
+        const int stride = M / 8;
+        const float h = 0.70710678118654752f;
+        const codelet_twiddle one = { 1.f, 0.f };
+
+        // Two 4-point transforms of the even and odd samples, then one radix-2 stage
+        fft_batch_sample e[4] = { in[0], in[2 * stride], in[4 * stride], in[6 * stride] };
+        fft_batch_sample o[4] = { in[stride], in[3 * stride], in[5 * stride], in[7 * stride] };
+        batch_butterfly4<Inverse>(e[0], e[1], e[2], e[3], one, one, one);
+        batch_butterfly4<Inverse>(o[0], o[1], o[2], o[3], one, one, one);
+
+        // Odd half rotated by 1, (1 -+ i) / sqrt2, -+i, (-1 -+ i) / sqrt2
+        const codelet_twiddle w[4] = { { 1.f, 0.f }, { h, -h }, { 0.f, -1.f }, { -h, -h } };
+        for (int k = 0; k < 4; ++k)
+        {
+            const fft_batch_sample & ek = e[k];
+            const fft_batch_sample & ok = o[k];
+            const float wi = Inverse ? -w[k].im : w[k].im;
+            for (int l = 0; l < fft_batch_lanes; ++l)
+            {
+                const float tr = ok.re[l] * w[k].re - ok.im[l] * wi, ti = ok.re[l] * wi + ok.im[l] * w[k].re;
+                out[k].re[l] = ek.re[l] + tr; out[k].im[l] = ek.im[l] + ti;
+                out[k + 4].re[l] = ek.re[l] - tr; out[k + 4].im[l] = ek.im[l] - ti;
+            }
+        }
+    }
+};
+
+template <int N, bool Inverse>
+inline void run_fft_batch_codelet(const fft_batch_sample * in, fft_batch_sample * out)
+{
+    fft_batch_codelet<N, N, Inverse>::run(in, out);
+}
+
+typedef void (*fft_batch_codelet_fn)(const fft_batch_sample *, fft_batch_sample *);
+
+inline fft_batch_codelet_fn find_fft_batch_codelet(const int n, const bool inverse)
+{
+    switch (n)
+    {
+    case 256: return inverse ? &run_fft_batch_codelet<256, true> : &run_fft_batch_codelet<256, false>;
+    case 512: return inverse ? &run_fft_batch_codelet<512, true> : &run_fft_batch_codelet<512, false>;
+    case 1024: return inverse ? &run_fft_batch_codelet<1024, true> : &run_fft_batch_codelet<1024, false>;
+    case 2048: return inverse ? &run_fft_batch_codelet<2048, true> : &run_fft_batch_codelet<2048, false>;
+    case 4096: return inverse ? &run_fft_batch_codelet<4096, true> : &run_fft_batch_codelet<4096, false>;
+    default: return nullptr;
+    }
+}
+
+#endif // end fft_codelets_hpp
@@ -0,0 +1,146 @@
+#ifndef filter_hpp
+#define filter_hpp
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include "image.hpp"
+#include "fft.hpp"
+#include "thread_pool.hpp"
+
+//////////////////////////////////
+//   Frequency Domain Filters   //
+//////////////////////////////////
+
+enum class filter_type { none, low_pass, high_pass, band_pass, notch };
+
+inline const char * filter_name(const filter_type f)
+{
+    switch (f)
+    {
+    case filter_type::low_pass: return "low-pass";
+    case filter_type::high_pass: return "high-pass";
+    case filter_type::band_pass: return "band-pass";
+    case filter_type::notch: return "notch";
+    default: return "none";
+    }
+}
+
+struct filter_params
+{
+    filter_type type = filter_type::none;
+    float cutoff = 0.125f;          // cycles/px; the centre of the band for band-pass
+    float bandwidthOctaves = 1.f;   // band-pass only
+    int order = 4;                  // butterworth order of the transitions; higher is sharper but rings more
+    std::vector<float2> notches;    // notch only, signed frequencies in cycles/px; the conjugate is removed too
+    float notchRadius = 0.01f;      // cycles/px
+};
+
+// Butterworth low-pass response, from the squared radius so that no sqrt or pow is needed per frequency
+inline float butterworth(const float r2, const float cutoff, const int order)
+{
+    const float q = r2 / std::max(cutoff * cutoff, 1e-12f);
+    float qn = 1.f;
+    for (int i = 0; i < order; ++i) qn *= q;
+    return 1.f / (1.f + qn);
+}
+
+inline float filter_response(const filter_params & p, const float u, const float v)
+{
+    const float r2 = u * u + v * v;
+    switch (p.type)
+    {
+    case filter_type::low_pass: return butterworth(r2, p.cutoff, p.order);
+    case filter_type::high_pass: return 1.f - butterworth(r2, p.cutoff, p.order);
+    case filter_type::band_pass:
+    {
+        const float half = std::pow(2.f, 0.5f * p.bandwidthOctaves);
+        return butterworth(r2, p.cutoff * half, p.order) * (1.f - butterworth(r2, p.cutoff / half, p.order));
+    }
+    case filter_type::notch:
+    {
+        float gain = 1.f;
+        for (auto & n : p.notches)
+        {
+            const float d0 = (u - n.x) * (u - n.x) + (v - n.y) * (v - n.y);
+            const float d1 = (u + n.x) * (u + n.x) + (v + n.y) * (v + n.y);
+            const float s = 2.f * p.notchRadius * p.notchRadius;
+            gain *= (1.f - std::exp(-d0 / s)) * (1.f - std::exp(-d1 / s));
+        }
+        return gain;
+    }
+    default: return 1.f;
+    }
+}
+
+// Interactive filtering of one image. The forward spectrum is computed once on construction; each apply() only
+// multiplies by the mask and runs the inverse transform, reusing the same scratch buffer. DC always passes, so
+// previews keep the brightness of the source.
+class spectrum_filter
+{
+    int2 size;
+    std::vector<std::complex<float>> spectrum;
+    std::vector<std::complex<float>> scratch;
+    std::vector<float> frequencyX, frequencyY;
+    float maxLogMagnitude = 0;
+
+public:
+
+    spectrum_filter(image_buffer<float, 1> & img) : size(img.size), spectrum(img.num_pixels()), scratch(img.num_pixels()), frequencyX(size.x), frequencyY(size.y)
+    {
+        for (int i = 0; i < img.num_pixels(); ++i) spectrum[i] = img.alias[i];
+        compute_fft_2d(spectrum.data(), size);
+        for (int x = 0; x < size.x; ++x) frequencyX[x] = float(signed_frequency(x, size.x)) / size.x;
+        for (int y = 0; y < size.y; ++y) frequencyY[y] = float(signed_frequency(y, size.y)) / size.y;
+
+        // DC excluded
+        std::vector<float> logMagnitude(img.num_pixels());
+        parallel_for(0, size.y, 64, [&](int y0, int y1)
+        {
+            for (size_t i = size_t(y0) * size.x, end = size_t(y1) * size.x; i < end; ++i) logMagnitude[i] = std::log1p(std::abs(spectrum[i]));
+        });
+        if (logMagnitude.size() > 1) maxLogMagnitude = reduce_samples(logMagnitude.data() + 1, logMagnitude.size() - 1).max;
+    }
+
+    const std::vector<std::complex<float>> & forward_spectrum() const { return spectrum; }
+
+    // Filtered spectrum, left in the scratch buffer until the next call
+    const std::vector<std::complex<float>> & apply_mask(const filter_params & p)
+    {
+        parallel_for(0, size.y, 16, [&](int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                const size_t row = size_t(y) * size.x;
+                for (int x = 0; x < size.x; ++x) scratch[row + x] = spectrum[row + x] * filter_response(p, frequencyX[x], frequencyY[y]);
+            }
+        });
+        scratch[0] = spectrum[0];
+        return scratch;
+    }
+
+    // Filtered image. Optionally also returns the centered log magnitude of the masked spectrum, scaled
+    // by the unfiltered maximum (DC excluded) so the effect of the mask stays visible.
+    image_buffer<float, 1> apply(const filter_params & p, image_buffer<float, 1> * maskedSpectrum = nullptr)
+    {
+        apply_mask(p);
+
+        if (maskedSpectrum)
+        {
+            const int halfWidth = size.x / 2, halfHeight = size.y / 2;
+            const float scale = maxLogMagnitude > 0 ? 1.f / maxLogMagnitude : 1.f;
+            for (int y = 0; y < size.y; ++y)
+                for (int x = 0; x < size.x; ++x)
+                    (*maskedSpectrum)(y, x) = std::log1p(std::abs(scratch[size_t((y + halfHeight) % size.y) * size.x + (x + halfWidth) % size.x])) * scale;
+        }
+
+        compute_fft_2d(scratch.data(), size, true);
+
+        image_buffer<float, 1> out(size);
+        const float scale = 1.f / (float(size.x) * size.y);
+        for (int i = 0; i < out.num_pixels(); ++i) out.alias[i] = scratch[i].real() * scale;
+        return out;
+    }
+};
+
+#endif // end filter_hpp
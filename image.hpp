@@ -0,0 +1,629 @@
+#ifndef image_hpp
+#define image_hpp
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include "util.hpp"
+#include "png_decode.hpp"
+#include "texture_container.hpp"
+#include "thread_pool.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+////////////////////
+//   Reductions   //
+////////////////////
+
+struct sample_statistics
+{
+    size_t count = 0;
+    double sum = 0;
+    double mean = 0;
+    double variance = 0; // population variance
+    float min = 0, max = 0;
+};
+
+// Statistics of values[begin, end) spaced stride apart, with variance left as the sum of squared deviations.
+// Accumulates in 8 independent double lanes, so the loop vectorizes without reassociating.
+inline sample_statistics reduce_sample_chunk(const float * values, const size_t begin, const size_t end, const size_t stride)
+{
+    const int lanes = 8;
+    // Sums of the deviations from the chunk's first sample, so the squares don't cancel for a large mean
+    const float shift = values[begin * stride];
+    double sum[lanes] = {}, squares[lanes] = {};
+    float lo[lanes], hi[lanes];
+    for (int l = 0; l < lanes; ++l) lo[l] = hi[l] = shift;
+
+    size_t i = begin;
+    for (; i + lanes <= end; i += lanes)
+    {
+        for (int l = 0; l < lanes; ++l)
+        {
+            const float v = values[(i + l) * stride];
+            const double d = double(v) - shift;
+            sum[l] += d;
+            squares[l] += d * d;
+            lo[l] = std::min(lo[l], v);
+            hi[l] = std::max(hi[l], v);
+        }
+    }
+    for (; i < end; ++i)
+    {
+        const float v = values[i * stride];
+        const double d = double(v) - shift;
+        sum[0] += d;
+        squares[0] += d * d;
+        lo[0] = std::min(lo[0], v);
+        hi[0] = std::max(hi[0], v);
+    }
+
+    sample_statistics p;
+    p.count = end - begin;
+    double deviation = 0, squared = 0;
+    for (int l = 0; l < lanes; ++l) { deviation += sum[l]; squared += squares[l]; p.min = l ? std::min(p.min, lo[l]) : lo[l]; p.max = l ? std::max(p.max, hi[l]) : hi[l]; }
+    p.mean = shift + deviation / p.count;
+    p.sum = double(shift) * p.count + deviation;
+    p.variance = std::max(0.0, squared - deviation * deviation / p.count);
+    return p;
+}
+
+// Sum, mean, variance and range of count floats spaced stride apart, in one pass. Chunks of 64K samples run as
+// parallel jobs, and the chunk results are then merged pairwise (Chan et al.), so rounding grows with log(chunks)
+// rather than with the sample count: the mean of 16K^2 samples is exact to double precision, where a running float
+// sum loses all digits. A single chunk is reduced on the calling thread without allocating.
+inline sample_statistics reduce_samples(const float * values, const size_t count, const size_t stride = 1)
+{
+    sample_statistics result;
+    if (count == 0) return result;
+
+    const size_t grain = size_t(1) << 16;
+    if (count <= grain)
+    {
+        result = reduce_sample_chunk(values, 0, count, stride);
+        result.variance /= result.count;
+        return result;
+    }
+
+    std::vector<sample_statistics> partials((count + grain - 1) / grain);
+    parallel_for(0, (int)partials.size(), 1, [&](int c0, int c1)
+    {
+        for (int c = c0; c < c1; ++c) partials[c] = reduce_sample_chunk(values, size_t(c) * grain, std::min(count, size_t(c + 1) * grain), stride);
+    });
+
+    for (size_t step = 1; step < partials.size(); step *= 2)
+    {
+        for (size_t i = 0; i + step < partials.size(); i += 2 * step)
+        {
+            sample_statistics & a = partials[i];
+            const sample_statistics & b = partials[i + step];
+            const double n = double(a.count + b.count), delta = b.mean - a.mean;
+            a.variance += b.variance + delta * delta * (double(a.count) * double(b.count) / n);
+            a.mean += delta * (b.count / n);
+            a.sum += b.sum;
+            a.count += b.count;
+            a.min = std::min(a.min, b.min);
+            a.max = std::max(a.max, b.max);
+        }
+    }
+
+    result = partials[0];
+    result.variance /= result.count;
+    return result;
+}
+
+////////////////
+//   Images   //
+////////////////
+
+// Interleaved stores the channels of a pixel together (rgbrgb...); planar stores each channel as its own contiguous
+// image, so per-channel kernels see dense rows.
+enum class image_layout { interleaved, planar };
+
+// Non-owning window onto image samples with arbitrary strides, in elements: sub-rectangles, single rows or columns
+// and single channels of a buffer are all views of the same memory, with no copy. T may be const.
+template <typename T, int C>
+struct image_view
+{
+    T * origin = nullptr;
+    int2 size = { 0, 0 };
+    ptrdiff_t rowStride = 0, pixelStride = C, channelStride = 1;
+
+    image_view() {}
+    image_view(T * origin, const int2 size, const ptrdiff_t rowStride, const ptrdiff_t pixelStride = C, const ptrdiff_t channelStride = 1) : origin(origin), size(size), rowStride(rowStride), pixelStride(pixelStride), channelStride(channelStride) {}
+
+    // A view of mutable samples is also a view of const ones
+    template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+    image_view(const image_view<U, C> & r) : origin(r.origin), size(r.size), rowStride(r.rowStride), pixelStride(r.pixelStride), channelStride(r.channelStride) {}
+
+    int num_pixels() const { return size.x * size.y; }
+    bool dense_rows() const { return pixelStride == 1; }
+
+    T & operator()(const int y, const int x, const int channel = 0) const { return origin[y * rowStride + x * pixelStride + channel * channelStride]; }
+    T * row_data(const int y) const { return origin + y * rowStride; }
+
+    image_view subview(const int2 offset, const int2 subSize) const { return image_view(origin + offset.y * rowStride + offset.x * pixelStride, subSize, rowStride, pixelStride, channelStride); }
+    image_view row(const int y) const { return subview({ 0, y }, { size.x, 1 }); }
+    image_view column(const int x) const { return subview({ x, 0 }, { 1, size.y }); }
+    image_view<T, 1> channel(const int c) const { return image_view<T, 1>(origin + c * channelStride, size, rowStride, pixelStride, 0); }
+};
+
+// Element-wise copy between views of the same size, e.g. to paste an image into part of another
+template <typename S, typename D, int C>
+inline void copy_view(const image_view<S, C> & src, const image_view<D, C> & dst)
+{
+    assert(src.size == dst.size);
+    for (int y = 0; y < src.size.y; ++y)
+        for (int x = 0; x < src.size.x; ++x)
+            for (int c = 0; c < C; ++c) dst(y, x, c) = src(y, x, c);
+}
+
+// Mean of a view weighted by the separable window wx[x] * wy[y]. totalWeight is the sum of all the weights, which
+// only depends on the window, so callers weighting many tiles compute it once. Bands of about 64K samples run as
+// parallel jobs like reduce_samples, and the band sums are merged pairwise; a small view is a single band.
+inline double windowed_mean(const image_view<const float, 1> & view, const float * wx, const float * wy, const double totalWeight)
+{
+    auto band_sum = [&](const int y0, const int y1)
+    {
+        double sum = 0;
+        for (int y = y0; y < y1; ++y)
+        {
+            const float * src = view.row_data(y);
+            double rowSum = 0;
+            for (int x = 0; x < view.size.x; ++x) rowSum += wx[x] * src[x];
+            sum += wy[y] * rowSum;
+        }
+        return sum;
+    };
+
+    const int rowsPerBand = std::max(1, (1 << 16) / std::max(view.size.x, 1));
+    const int numBands = (view.size.y + rowsPerBand - 1) / rowsPerBand;
+    if (numBands <= 1) return band_sum(0, view.size.y) / totalWeight;
+
+    std::vector<double> partials(numBands);
+    parallel_for(0, numBands, 1, [&](int b0, int b1)
+    {
+        for (int b = b0; b < b1; ++b) partials[b] = band_sum(b * rowsPerBand, std::min(view.size.y, (b + 1) * rowsPerBand));
+    });
+    for (size_t step = 1; step < partials.size(); step *= 2)
+        for (size_t i = 0; i + step < partials.size(); i += 2 * step) partials[i] += partials[i + step];
+    return partials[0] / totalWeight;
+}
+
+template <typename T, int C, image_layout L = image_layout::interleaved>
+struct image_buffer
+{
+    const int2 size;
+    T * alias = nullptr;
+    struct delete_array { void operator()(T * p) { delete[] p; } };
+    std::unique_ptr<T, decltype(image_buffer::delete_array())> data;
+    image_buffer() : size({ 0, 0 }) { }
+    image_buffer(const int2 size) : size(size), data(new T[size.x * size.y * C], delete_array()) { alias = data.get(); }
+    image_buffer(const image_buffer & r) : size(r.size), data(new T[size.x * size.y * C], delete_array())
+    {
+        alias = data.get();
+        if(r.alias) std::memcpy(alias, r.alias, size.x * size.y * C * sizeof(T));
+    }
+    int size_bytes() const { return C * size.x * size.y * sizeof(T); }
+    int num_pixels() const { return size.x * size.y; }
+    size_t index(int y, int x, int channel) const { return L == image_layout::planar ? (size_t(channel) * size.y + y) * size.x + x : C * (size_t(y) * size.x + x) + channel; }
+    T & operator()(int y, int x) { return alias[index(y, x, 0)]; }
+    T & operator()(int y, int x, int channel) { return alias[index(y, x, channel)]; }
+    const T & operator()(int y, int x) const { return alias[index(y, x, 0)]; }
+    const T & operator()(int y, int x, int channel) const { return alias[index(y, x, channel)]; }
+    T compute_mean() const { return T(reduce_samples(alias, size_t(size.x) * size.y * C).mean); }
+
+    image_view<T, C> view() { return make_view<T>(alias); }
+    image_view<const T, C> view() const { return make_view<const T>(alias); }
+    image_view<T, 1> channel(const int c) { return view().channel(c); }
+    image_view<const T, 1> channel(const int c) const { return view().channel(c); }
+
+private:
+
+    template <typename V>
+    image_view<V, C> make_view(V * p) const
+    {
+        if (L == image_layout::planar) return image_view<V, C>(p, size, size.x, 1, ptrdiff_t(size.x) * size.y);
+        return image_view<V, C>(p, size, ptrdiff_t(size.x) * C, C, 1);
+    }
+};
+
+/////////////////////////
+//   Compact Storage   //
+/////////////////////////
+
+// Precision of magnitude spectra kept around for display (mip pyramid, layer thumbnails). Spectra are always
+// computed in float; normalized display values need far fewer bits, and 16-bit storage halves memory and
+// upload bandwidth. fp16 keeps 11 bits of precision over [6e-5, 65504], bfloat16 8 bits over the float range.
+enum class spectrum_storage { float32, float16, bfloat16 };
+
+inline const char * storage_name(const spectrum_storage s)
+{
+    switch (s)
+    {
+    case spectrum_storage::float16: return "fp16";
+    case spectrum_storage::bfloat16: return "bf16";
+    default: return "fp32";
+    }
+}
+
+inline spectrum_storage storage_from_name(const std::string & name)
+{
+    for (auto s : { spectrum_storage::float32, spectrum_storage::float16, spectrum_storage::bfloat16 })
+    {
+        if (name == storage_name(s)) return s;
+    }
+    throw std::runtime_error("unknown storage " + name);
+}
+
+template <typename T> inline T stored_sample(const float v);
+template <> inline float stored_sample<float>(const float v) { return v; }
+template <> inline half stored_sample<half>(const float v) { return float_to_half(v); }
+template <> inline bfloat16 stored_sample<bfloat16>(const float v) { return float_to_bfloat16(v); }
+
+////////////////////////////////
+//   Luminance Decode Kernels  //
+////////////////////////////////
+
+template <typename T> inline float normalized_sample(const T v);
+template <> inline float normalized_sample<uint8_t>(const uint8_t v) { return v * (1.f / 255.f); }
+template <> inline float normalized_sample<uint16_t>(const uint16_t v) { return v * (1.f / 65535.f); }
+template <> inline float normalized_sample<float>(const float v) { return v; }
+template <> inline float normalized_sample<half>(const half v) { return half_to_float(v); }
+template <> inline float normalized_sample<bfloat16>(const bfloat16 v) { return bfloat16_to_float(v); }
+
+// Copy of a single channel float image at another storage precision
+template <typename T>
+inline image_buffer<T, 1> convert_image(const image_buffer<float, 1> & in)
+{
+    image_buffer<T, 1> out(in.size);
+    for (int i = 0; i < in.num_pixels(); ++i) out.alias[i] = stored_sample<T>(in.alias[i]);
+    return out;
+}
+
+// Fixed channel count keeps the inner loop free of branches and strides known at compile time, so it vectorizes
+template <typename T, int C>
+inline void luminance_row(const T * src, float * dst, const int width)
+{
+    for (int x = 0; x < width; ++x, src += C)
+    {
+        if (C < 3) dst[x] = normalized_sample(src[0]);
+        else dst[x] = to_luminance(normalized_sample(src[0]), normalized_sample(src[1]), normalized_sample(src[2]));
+    }
+}
+
+// 8-bit samples skip the per-channel float conversion. Colour uses integer luma weights with 15 fractional bits that
+// sum to exactly 32768 (so white stays exactly 1), one int -> float per pixel; grey is a 256 entry table. With SSE2,
+// four pixels at a time are widened to 16 bits and weighted with one pmaddwd per pair of pixels.
+struct byte_luminance
+{
+    static const int wr = 6966, wg = 23436, wb = 2366;
+    float table[256];
+
+    byte_luminance() { for (int i = 0; i < 256; ++i) table[i] = i * (1.f / 255.f); }
+
+    static const byte_luminance & get() { static const byte_luminance lut; return lut; }
+
+    static float rgb(const uint8_t * p) { return float(wr * p[0] + wg * p[1] + wb * p[2]) * (1.f / (255.f * 32768.f)); }
+};
+
+template <int C>
+inline void byte_luminance_row(const uint8_t * src, float * dst, const int width)
+{
+    const float * table = byte_luminance::get().table;
+    int x = 0;
+
+#if defined(_M_X64) || defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.f / (255.f * 32768.f));
+    const __m128i weights = _mm_setr_epi16(byte_luminance::wr, byte_luminance::wg, byte_luminance::wb, 0, byte_luminance::wr, byte_luminance::wg, byte_luminance::wb, 0);
+
+    // Two pixels as 16-bit r g b x r g b x -> the luma of both in lanes 0 and 2 (plus b * wb in lanes 1 and 3)
+    auto weigh = [&](const __m128i rgbx, const __m128i rgbx2)
+    {
+        const __m128 a = _mm_castsi128_ps(_mm_madd_epi16(rgbx, weights)), b = _mm_castsi128_ps(_mm_madd_epi16(rgbx2, weights));
+        const __m128i luma = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+        return _mm_mul_ps(_mm_cvtepi32_ps(luma), scale);
+    };
+
+    if (C == 4)
+    {
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * x));
+            const __m128i alphaMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+            _mm_storeu_ps(dst + x, weigh(_mm_and_si128(_mm_unpacklo_epi8(v, zero), alphaMask), _mm_and_si128(_mm_unpackhi_epi8(v, zero), alphaMask)));
+        }
+    }
+    else if (C == 3)
+    {
+        // 16 byte loads cover 5 and a third pixels, so stop while the load stays inside the row
+        const __m128i first = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0), second = _mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0);
+        for (; x + 6 <= width; x += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * x));
+            const __m128i p01 = _mm_unpacklo_epi8(v, zero), p23 = _mm_unpacklo_epi8(_mm_srli_si128(v, 6), zero);
+            const __m128i rgbx01 = _mm_or_si128(_mm_and_si128(p01, first), _mm_and_si128(_mm_slli_si128(p01, 2), second));
+            const __m128i rgbx23 = _mm_or_si128(_mm_and_si128(p23, first), _mm_and_si128(_mm_slli_si128(p23, 2), second));
+            _mm_storeu_ps(dst + x, weigh(rgbx01, rgbx23));
+        }
+    }
+    else
+    {
+        const __m128 byteScale = _mm_set1_ps(1.f / 255.f);
+        const __m128i evenBytes = _mm_set1_epi16(0xff);
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i grey;
+            if (C == 2) grey = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * x)), evenBytes);
+            else grey = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + x)), zero);
+            _mm_storeu_ps(dst + x, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(grey, zero)), byteScale));
+            _mm_storeu_ps(dst + x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(grey, zero)), byteScale));
+        }
+    }
+#endif
+
+    for (; x < width; ++x) dst[x] = C < 3 ? table[src[C * x]] : byte_luminance::rgb(src + C * x);
+}
+
+template <> inline void luminance_row<uint8_t, 1>(const uint8_t * src, float * dst, const int width) { byte_luminance_row<1>(src, dst, width); }
+template <> inline void luminance_row<uint8_t, 2>(const uint8_t * src, float * dst, const int width) { byte_luminance_row<2>(src, dst, width); }
+template <> inline void luminance_row<uint8_t, 3>(const uint8_t * src, float * dst, const int width) { byte_luminance_row<3>(src, dst, width); }
+template <> inline void luminance_row<uint8_t, 4>(const uint8_t * src, float * dst, const int width) { byte_luminance_row<4>(src, dst, width); }
+
+// Converts tightly packed interleaved samples of any supported type straight to float luminance
+template <typename T>
+inline void samples_to_luminance(const T * samples, const int channels, image_buffer<float, 1> & out)
+{
+    void (*convert_row)(const T *, float *, const int) = nullptr;
+    switch (channels)
+    {
+    case 1: convert_row = luminance_row<T, 1>; break;
+    case 2: convert_row = luminance_row<T, 2>; break;
+    case 3: convert_row = luminance_row<T, 3>; break;
+    case 4: convert_row = luminance_row<T, 4>; break;
+    default: throw std::runtime_error("unsupported number of channels");
+    }
+
+    const int width = out.size.x;
+    parallel_for(0, out.size.y, 64, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y) convert_row(samples + size_t(y) * width * channels, &out(y, 0), width);
+    });
+}
+
+////////////////////////
+//   Image Decoders   //
+////////////////////////
+
+// 8-bit pngs go through stb; 16-bit pngs are decoded at full precision
+inline image_buffer<float, 1> png_to_luminance(const uint8_t * binaryData, const size_t size)
+{
+    png_header header;
+    if (png_read_header(binaryData, size, header) && header.bitDepth == 16 && !header.interlace)
+    {
+        std::vector<uint16_t> samples = png_decode_16(binaryData, size, header);
+        image_buffer<float, 1> buffer({ header.width, header.height });
+        samples_to_luminance(samples.data(), header.channels(), buffer);
+        return buffer;
+    }
+
+    int width, height, nBytes;
+    auto data = stbi_load_from_memory(binaryData, (int)size, &width, &height, &nBytes, 0);
+    if (!data) throw std::runtime_error(std::string("couldn't decode png - ") + stbi_failure_reason());
+
+    image_buffer<float, 1> buffer({ width, height });
+    samples_to_luminance(data, nBytes, buffer);
+    stbi_image_free(data);
+    return buffer;
+}
+
+// Luminance of a png one row at a time, straight from the mapped file (see png_row_reader for what it handles)
+class png_luminance_reader
+{
+    std::shared_ptr<const mapped_file> file;
+    png_row_reader reader;
+    std::vector<uint16_t> wide;
+    std::vector<uint8_t> expanded;
+
+public:
+
+    png_luminance_reader(const std::shared_ptr<const mapped_file> & file) : file(file), reader(file->data(), file->size()) {}
+
+    static bool supports(const mapped_file & file)
+    {
+        png_header header;
+        return png_read_header(file.data(), file.size(), header) && png_row_reader::supports(header);
+    }
+
+    int2 size() const { return { reader.header().width, reader.header().height }; }
+
+    void read_row(float * dst)
+    {
+        const png_header & h = reader.header();
+        const uint8_t * row = reader.next_row();
+        const int samples = h.width * h.channels();
+
+        if (h.colorType == 3)
+        {
+            expanded.resize(size_t(h.width) * 3);
+            for (int x = 0; x < h.width; ++x) std::memcpy(&expanded[3 * x], &reader.palette()[3 * row[x]], 3);
+            luminance_row<uint8_t, 3>(expanded.data(), dst, h.width);
+            return;
+        }
+
+        if (h.bitDepth == 16)
+        {
+            wide.resize(samples);
+            for (int i = 0; i < samples; ++i) wide[i] = uint16_t((row[2 * i] << 8) | row[2 * i + 1]);
+        }
+
+        switch (h.channels())
+        {
+        case 1: h.bitDepth == 16 ? luminance_row<uint16_t, 1>(wide.data(), dst, h.width) : luminance_row<uint8_t, 1>(row, dst, h.width); break;
+        case 2: h.bitDepth == 16 ? luminance_row<uint16_t, 2>(wide.data(), dst, h.width) : luminance_row<uint8_t, 2>(row, dst, h.width); break;
+        case 3: h.bitDepth == 16 ? luminance_row<uint16_t, 3>(wide.data(), dst, h.width) : luminance_row<uint8_t, 3>(row, dst, h.width); break;
+        case 4: h.bitDepth == 16 ? luminance_row<uint16_t, 4>(wide.data(), dst, h.width) : luminance_row<uint8_t, 4>(row, dst, h.width); break;
+        }
+    }
+};
+
+// Radiance .hdr, kept in linear float
+inline image_buffer<float, 1> hdr_to_luminance(const uint8_t * binaryData, const size_t size)
+{
+    int width, height, nComponents;
+    float * data = stbi_loadf_from_memory(binaryData, (int)size, &width, &height, &nComponents, 0);
+    if (!data) throw std::runtime_error(std::string("couldn't decode hdr - ") + stbi_failure_reason());
+
+    image_buffer<float, 1> buffer({ width, height });
+    samples_to_luminance(data, nComponents, buffer);
+    stbi_image_free(data);
+    return buffer;
+}
+
+// Decodes one image of a texture to luminance. Plain 8/16-bit and float formats are read directly from the view,
+// BC1-5 are decompressed a whole 4x4 block at a time with gli's block decoders, and every other format goes through
+// gli's per-texel conversion table (which needs its own copy of the level).
+inline image_buffer<float, 1> texture_to_luminance(const texture_level_view & view)
+{
+    using namespace gli::detail;
+
+    const gli::format format = view.format;
+    const int width = view.extent.x, height = view.extent.y;
+    // Two-channel data is grey+alpha everywhere (as in luminance_row and PNG), so only R carries luminance
+    const bool greyOnly = gli::component_count(format) <= 2;
+
+    image_buffer<float, 1> buffer({ width, height });
+    const void * texels = view.data;
+
+    switch (format)
+    {
+    case gli::FORMAT_R8_UNORM_PACK8: case gli::FORMAT_L8_UNORM_PACK8: samples_to_luminance(static_cast<const uint8_t *>(texels), 1, buffer); return buffer;
+    case gli::FORMAT_RGB8_UNORM_PACK8: case gli::FORMAT_RGB8_SRGB_PACK8: samples_to_luminance(static_cast<const uint8_t *>(texels), 3, buffer); return buffer;
+    case gli::FORMAT_RGBA8_UNORM_PACK8: case gli::FORMAT_RGBA8_SRGB_PACK8: samples_to_luminance(static_cast<const uint8_t *>(texels), 4, buffer); return buffer;
+    case gli::FORMAT_R16_UNORM_PACK16: case gli::FORMAT_L16_UNORM_PACK16: samples_to_luminance(static_cast<const uint16_t *>(texels), 1, buffer); return buffer;
+    case gli::FORMAT_RGBA16_UNORM_PACK16: samples_to_luminance(static_cast<const uint16_t *>(texels), 4, buffer); return buffer;
+    case gli::FORMAT_R16_SFLOAT_PACK16: samples_to_luminance(static_cast<const half *>(texels), 1, buffer); return buffer;
+    case gli::FORMAT_RG16_SFLOAT_PACK16: samples_to_luminance(static_cast<const half *>(texels), 2, buffer); return buffer;
+    case gli::FORMAT_RGB16_SFLOAT_PACK16: samples_to_luminance(static_cast<const half *>(texels), 3, buffer); return buffer;
+    case gli::FORMAT_RGBA16_SFLOAT_PACK16: samples_to_luminance(static_cast<const half *>(texels), 4, buffer); return buffer;
+    case gli::FORMAT_R32_SFLOAT_PACK32: samples_to_luminance(static_cast<const float *>(texels), 1, buffer); return buffer;
+    case gli::FORMAT_RG32_SFLOAT_PACK32: samples_to_luminance(static_cast<const float *>(texels), 2, buffer); return buffer;
+    case gli::FORMAT_RGB32_SFLOAT_PACK32: samples_to_luminance(static_cast<const float *>(texels), 3, buffer); return buffer;
+    case gli::FORMAT_RGBA32_SFLOAT_PACK32: samples_to_luminance(static_cast<const float *>(texels), 4, buffer); return buffer;
+    default: break;
+    }
+
+    auto write_texel = [&](int y, int x, const glm::vec4 & c)
+    {
+        if (x < width && y < height) buffer(y, x) = greyOnly ? c.r : to_luminance(c.r, c.g, c.b);
+    };
+
+    if (gli::is_compressed(format))
+    {
+        const gli::ivec3 blockExtent = gli::block_extent(format);
+        const int blocksX = std::max(1, (width + blockExtent.x - 1) / blockExtent.x);
+        const int blocksY = std::max(1, (height + blockExtent.y - 1) / blockExtent.y);
+
+        std::function<texel_block4x4(const void *)> decode_block;
+        switch (format)
+        {
+        case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8: case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8:
+        case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8: case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+            decode_block = [](const void * b) { return decompress_dxt1_block(*static_cast<const dxt1_block *>(b)); }; break;
+        case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16: case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+            decode_block = [](const void * b) { return decompress_dxt3_block(*static_cast<const dxt3_block *>(b)); }; break;
+        case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16: case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+            decode_block = [](const void * b) { return decompress_dxt5_block(*static_cast<const dxt5_block *>(b)); }; break;
+        case gli::FORMAT_R_ATI1N_UNORM_BLOCK8:
+            decode_block = [](const void * b) { return decompress_bc4unorm_block(*static_cast<const bc4_block *>(b)); }; break;
+        case gli::FORMAT_R_ATI1N_SNORM_BLOCK8:
+            decode_block = [](const void * b) { return decompress_bc4snorm_block(*static_cast<const bc4_block *>(b)); }; break;
+        case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+            decode_block = [](const void * b) { return decompress_bc5unorm_block(*static_cast<const bc5_block *>(b)); }; break;
+        case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+            decode_block = [](const void * b) { return decompress_bc5snorm_block(*static_cast<const bc5_block *>(b)); }; break;
+        default: throw std::runtime_error("unsupported compressed texture format");
+        }
+
+        const uint8_t * blocks = static_cast<const uint8_t *>(texels);
+        const size_t blockBytes = gli::block_size(format);
+
+        for (int by = 0; by < blocksY; ++by)
+        {
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+                const texel_block4x4 decoded = decode_block(blocks + (by * blocksX + bx) * blockBytes);
+                for (int row = 0; row < 4; ++row)
+                    for (int col = 0; col < 4; ++col)
+                        write_texel(by * 4 + row, bx * 4 + col, decoded.Texel[row][col]);
+            }
+        }
+    }
+    else
+    {
+        gli::texture2d t2d(format, gli::extent2d(width, height), 1);
+        std::memcpy(t2d.data(), view.data, std::min(view.size, t2d.size()));
+        auto fetch = convert<gli::texture2d, float, gli::defaultp>::call(format).Fetch;
+        if (!fetch) throw std::runtime_error("unsupported texture format");
+
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                write_texel(y, x, fetch(t2d, gli::extent2d(x, y), 0, 0, 0));
+    }
+
+    return buffer;
+}
+
+// Decodes every z slice of a volume level to luminance, x fastest then y then z
+inline std::vector<float> volume_to_luminance(const texture_level_view & view)
+{
+    const int3 e = view.extent;
+    const size_t sliceBytes = view.size / e.z;
+    const size_t sliceSize = size_t(e.x) * e.y;
+
+    std::vector<float> voxels(sliceSize * e.z);
+    for (int z = 0; z < e.z; ++z)
+    {
+        const texture_level_view slice = { view.format, { e.x, e.y, 1 }, static_cast<const uint8_t *>(view.data) + z * sliceBytes, sliceBytes };
+        auto img = texture_to_luminance(slice);
+        std::copy(img.alias, img.alias + sliceSize, voxels.begin() + z * sliceSize);
+    }
+    return voxels;
+}
+
+// Dispatches on the file's magic bytes. Textures contribute mip 0 of their first layer and face.
+inline image_buffer<float, 1> decode_luminance(const std::shared_ptr<const mapped_file> & file)
+{
+    switch (detect_container(file->data(), file->size()))
+    {
+    case container_format::png: return png_to_luminance(file->data(), file->size());
+    case container_format::hdr: return hdr_to_luminance(file->data(), file->size());
+    case container_format::dds:
+    case container_format::ktx:
+    case container_format::kmg: return texture_to_luminance(texture_container(file).view(0, 0, 0));
+    default: throw std::runtime_error("unsupported file format");
+    }
+}
+
+inline image_buffer<float, 1> load_luminance(const std::string & path)
+{
+    return decode_luminance(std::make_shared<const mapped_file>(path));
+}
+
+// Writes a [0, 1] luminance image as an 8-bit greyscale png
+inline void write_luminance_png(const std::string & path, image_buffer<float, 1> & img)
+{
+    std::vector<uint8_t> bytes(img.num_pixels());
+    for (int i = 0; i < img.num_pixels(); ++i) bytes[i] = (uint8_t)(clamp(img.alias[i], 0.f, 1.f) * 255.f + 0.5f);
+    if (!stbi_write_png(path.c_str(), img.size.x, img.size.y, 1, bytes.data(), img.size.x)) throw std::runtime_error("couldn't write " + path);
+}
+
+#endif // end image_hpp
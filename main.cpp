@@ -7,6 +7,9 @@
 #include <stdint.h>
 #include <complex>
 #include <type_traits>
+#include <sstream>
+#include <fstream>
+#include <limits>
 #include "util.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -15,7 +18,14 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "third-party/stb/stb_image_write.h"
 
-#include "kissfft/kissfft.hpp"
+#include "thread_pool.hpp"
+#include "image.hpp"
+#include "fft.hpp"
+#include "spectrum.hpp"
+#include "filter.hpp"
+#include "convolution.hpp"
+#include "registration.hpp"
+#include "out_of_core.hpp"
 
 /* todo
  * [ ] support rgb textures
@@ -38,32 +48,6 @@ public:
     GLuint handle() const { return tex; }
 };
 
-template <typename T, int C>
-struct image_buffer
-{
-    const int2 size;
-    T * alias;
-    struct delete_array { void operator()(T * p) { delete[] p; } };
-    std::unique_ptr<T, decltype(image_buffer::delete_array())> data;
-    image_buffer() : size({ 0, 0 }) { }
-    image_buffer(const int2 size) : size(size), data(new T[size.x * size.y * C], delete_array()) { alias = data.get(); }
-    image_buffer(const image_buffer<T, C> & r) : size(r.size), data(new T[size.x * size.y * C], delete_array())
-    {
-        alias = data.get();
-        if(r.alias) std::memcpy(alias, r.alias, size.x * size.y * C * sizeof(T));
-    }
-    int size_bytes() const { return C * size.x * size.y * sizeof(T); }
-    int num_pixels() const { return size.x * size.y; }
-    T & operator()(int y, int x) { return alias[y * size.x + x]; }
-    T & operator()(int y, int x, int channel) { return alias[C * (y * size.x + x) + channel]; }
-    T compute_mean() const
-    {
-        T m = 0.0f;
-        for (int x = 0; x < size.x * size.y; ++x) m += alias[x];
-        return m / (size.x * size.y);
-    }
-};
-
 inline void upload_png(texture_buffer & buffer, std::vector<uint8_t> & binaryData, bool flip = false)
 {
     if (flip) stbi_set_flip_vertically_on_load(1);
@@ -82,98 +66,22 @@ inline void upload_png(texture_buffer & buffer, std::vector<uint8_t> & binaryDat
     buffer.size = { width, height };
 }
 
-inline void upload_dds(texture_buffer & buffer, std::vector<uint8_t> & binaryData)
+// Uploads every level straight from the container's views (no intermediate gli copy)
+inline void upload_dds(texture_buffer & buffer, const texture_container & t)
 {
-    gli::texture t(gli::load_dds((char *)binaryData.data(), binaryData.size()));
+    gli::gl GL(gli::gl::PROFILE_GL33);
+    gli::gl::format const Format = GL.translate(t.format, t.swizzles);
 
-    for (std::size_t l = 0; l < t.levels(); ++l)
+    for (int l = 0; l < t.levels; ++l)
     {
-        GLsizei w = (t.extent(l).x), h = (t.extent(l).y);
-        gli::gl GL(gli::gl::PROFILE_GL33);
-        gli::gl::format const Format = GL.translate(t.format(), t.swizzles());
-        GLenum Target = GL.translate(t.target());
-        glCompressedTextureImage2DEXT(buffer.handle(), Target, GLint(l), Format.Internal, w, h, 0, t.size(l), t.data(0, 0, l));
+        const texture_level_view level = t.view(0, 0, l);
+        GLsizei w = level.extent.x, h = level.extent.y;
+        if (gli::is_compressed(t.format)) glCompressedTextureImage2DEXT(buffer.handle(), GL_TEXTURE_2D, GLint(l), Format.Internal, w, h, 0, GLsizei(level.size), level.data);
+        else glTextureImage2DEXT(buffer.handle(), GL_TEXTURE_2D, GLint(l), Format.Internal, w, h, 0, Format.External, Format.Type, level.data);
         if (l == 0) buffer.size = { w, h };
     }
 }
 
-image_buffer<float, 1> png_to_luminance(std::vector<uint8_t> & binaryData)
-{
-    int width, height, nBytes;
-    auto data = stbi_load_from_memory(binaryData.data(), (int)binaryData.size(), &width, &height, &nBytes, 0);
- 
-    image_buffer<float, 1> buffer({ width, height });
-
-    for (int y = 0; y < height; y++)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            const float r = as_float<uint8_t>(data[nBytes * (y * width + x) + 0]);
-            const float g = as_float<uint8_t>(data[nBytes * (y * width + x) + 1]);
-            const float b = as_float<uint8_t>(data[nBytes * (y * width + x) + 2]);
-            buffer(y, x) = to_luminance(r, g, b);
-        }
-    }
-    stbi_image_free(data);
-    return buffer;
-}
-
-void center_fft_image(image_buffer<float, 1> & in, image_buffer<float, 1> & out)
-{
-    assert(in.size == out.size);
-
-    const int halfWidth = in.size.x / 2;
-    const int halfHeight = in.size.y / 2;
-
-    for (int i = 0; i < in.size.y; i++)
-    {
-        for (int j = 0; j < in.size.x; j++)
-        {
-            if (i < halfHeight)
-            {
-                if (j < halfWidth) out(i, j) = in(i + halfHeight, j + halfWidth);
-                else out(i, j) = in(i + halfWidth, j - halfWidth);
-            }
-            else 
-            {
-                if (j < halfWidth) out(i, j) = in(i - halfHeight, j + halfWidth);
-                else out(i, j) = in(i - halfHeight, j - halfWidth);
-            }
-        }
-    }
-}
-
-// In place
-void compute_fft_2d(std::complex<float> * data, const int2 & size, const bool inverse = false) 
-{
-    const int width = size.x;
-    const int height = size.y;
-
-    kissfft<float> xFFT(width, inverse);
-    kissfft<float> yFFT(height, inverse);
-
-    std::vector<std::complex<float>> xTmp(std::max(width, height));
-    std::vector<std::complex<float>> yTmp(std::max(width, height));
-    std::vector<std::complex<float>> ySrc(height);
-
-    // Compute FFT on X axis
-    for (int y = 0; y < height; ++y)
-    {
-        const std::complex<float> * inputRow = &data[y * width];
-        xFFT.transform(inputRow, xTmp.data());
-        for (int x = 0; x < width; x++) data[y * width + x] = xTmp[x];
-    }
-
-    // Compute FFT on Y axis
-    for (int x = 0; x < width; x++)
-    {
-        // For data locality, create a 1d src "row" out of the Y column
-        for (int y = 0; y < height; y++) ySrc[y] = data[y * width + x];
-        yFFT.transform(ySrc.data(), yTmp.data());
-        for (int y = 0; y < height; y++) data[y * width + x] = yTmp[y];
-    }
-}
-
 inline void draw_text(int x, int y, const char * text)
 {
     char buffer[64000];
@@ -202,36 +110,127 @@ void draw_texture_buffer(float rx, float ry, float rw, float rh, const texture_b
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+// Blue (0) through green and yellow to red (1), with constant alpha so the image underneath stays visible
+void upload_heatmap(texture_buffer & buffer, image_buffer<float, 1> & values, const float alpha = 0.5f)
+{
+    std::vector<float> rgba(values.num_pixels() * 4);
+    for (int i = 0; i < values.num_pixels(); ++i)
+    {
+        const float t = clamp(values.alias[i], 0.f, 1.f);
+        rgba[i * 4 + 0] = clamp(2.f * t - 0.5f, 0.f, 1.f);
+        rgba[i * 4 + 1] = clamp(2.f - std::abs(4.f * t - 2.f), 0.f, 1.f);
+        rgba[i * 4 + 2] = clamp(1.f - 2.f * t, 0.f, 1.f);
+        rgba[i * 4 + 3] = alpha;
+    }
+    glTextureParameteriEXT(buffer.handle(), GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureImage2DEXT(buffer.handle(), GL_TEXTURE_2D, 0, GL_RGBA, values.size.x, values.size.y, 0, GL_RGBA, GL_FLOAT, rgba.data());
+    buffer.size = values.size;
+}
+
+// Line plot of values scaled to fit the rectangle; log scale for spectra spanning many decades
+void draw_plot(float rx, float ry, float rw, float rh, const std::vector<float> & values, const bool logScale)
+{
+    if (values.size() < 2) return;
+
+    // Empty bins (zero power) sit on the floor of a log plot instead of stretching its range
+    float lo = std::numeric_limits<float>::max(), hi = -lo;
+    for (auto v : values)
+    {
+        if (logScale && v <= 0) continue;
+        const float t = logScale ? std::log10(v) : v;
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    if (lo > hi) return;
+    auto transform = [&](float v) { return logScale ? (v > 0 ? std::log10(v) : lo) : v; };
+    const float range = std::max(hi - lo, 1e-6f);
+
+    // Translucent backing so the plot can sit on top of the spectrum
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(0.f, 0.f, 0.f, 0.6f);
+    glBegin(GL_QUADS);
+    glVertex2f(rx, ry); glVertex2f(rx + rw, ry); glVertex2f(rx + rw, ry + rh); glVertex2f(rx, ry + rh);
+    glEnd();
+    glDisable(GL_BLEND);
+
+    glColor3f(1.f, 0.8f, 0.2f);
+    glBegin(GL_LINE_STRIP);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        glVertex2f(rx + rw * i / float(values.size() - 1), ry + rh - rh * (transform(values[i]) - lo) / range);
+    }
+    glEnd();
+    glColor3f(1.f, 1.f, 1.f);
+}
+
+// Places images side by side, top-aligned
+image_buffer<float, 1> concat_horizontal(const std::vector<image_buffer<float, 1> *> & images)
+{
+    int2 size = { 0, 0 };
+    for (auto img : images) { size.x += img->size.x; size.y = std::max(size.y, img->size.y); }
+
+    image_buffer<float, 1> out(size);
+    std::fill(out.alias, out.alias + out.num_pixels(), 0.f);
+    int ox = 0;
+    for (auto img : images)
+    {
+        copy_view(img->view(), out.view().subview({ ox, 0 }, img->size));
+        ox += img->size.x;
+    }
+    return out;
+}
 
 //////////////////////////
 //   Main Application   //
 //////////////////////////
 
-void downsample_half_box_filter(const image_buffer<float, 1> & in, image_buffer<float, 1> & out)
+void downsample_half_box_filter(const image_view<const float, 1> & in, const image_view<float, 1> & out)
 {
     const int w = std::max(1, in.size.x / 2);
     const int h = std::max(1, in.size.y / 2);
 
     if ((in.size.x & 1) == 0 && (in.size.y & 1) == 0)
     {
-        const float * src = in.alias;
-        float * dst = out.alias;
-
-        for (int y = 0; y < h; y++)
+        parallel_for(0, h, 64, [&](int y0, int y1)
         {
-            for (int x = 0; x < w; x++)
+            for (int y = y0; y < y1; y++)
             {
-                *dst = 0.25f * (src[0] + src[1] + src[in.size.x] + src[in.size.x + 1]);
-                dst++;
-                src += 2;
+                const float * src = in.row_data(2 * y);
+                const float * below = in.row_data(2 * y + 1);
+                float * dst = out.row_data(y);
+                for (int x = 0; x < w; x++) dst[x] = 0.25f * (src[2 * x] + src[2 * x + 1] + below[2 * x] + below[2 * x + 1]);
             }
-            src += in.size.x;
-        }
+        });
     }
 }
 
+void upload_luminance(texture_buffer & buffer, image_buffer<half, 1> & imgData)
+{
+    glTextureImage2DEXT(buffer.handle(), GL_TEXTURE_2D, 0, GL_LUMINANCE, imgData.size.x, imgData.size.y, 0, GL_LUMINANCE, GL_HALF_FLOAT, imgData.data.get());
+}
+
+// GL has no bfloat16 pixel type, but it is the top half of a float: widening is a shift
+void upload_luminance(texture_buffer & buffer, image_buffer<bfloat16, 1> & imgData)
+{
+    image_buffer<float, 1> widened(imgData.size);
+    for (int i = 0; i < imgData.num_pixels(); ++i) widened.alias[i] = bfloat16_to_float(imgData.alias[i]);
+    upload_luminance(buffer, widened);
+}
+
+// Mip chain of the image on screen, whatever precision it is stored at
+class display_pyramid
+{
+public:
+    virtual ~display_pyramid() {}
+    virtual size_t levels() const = 0;
+    virtual size_t size_bytes() const = 0;
+    virtual void upload(texture_buffer & buffer, const int level) = 0;
+};
+
+// Levels are filtered in float and stored as T
 template <typename T, int C>
-class image_buffer_pyramid
+class image_buffer_pyramid : public display_pyramid
 {
     void build_dimensions(std::vector<int2> & levels, int size)
     {
@@ -255,19 +254,51 @@ public:
         for (auto & l : levels) pyramid.emplace_back(std::make_shared<image_buffer<T, C>>(l));
     }
 
+    // The top level is read straight from the input. The smaller float levels in between are allocated up front so
+    // that the levels run as a task graph: storing level i and filtering it down to level i + 1 only wait for level i.
     void build(const image_buffer<float, 1> & in)
     {
-        // Copy for level 0
-        image_buffer<T, C> & originalSize = level(0);  
-        std::memcpy(originalSize.data.get(), in.data.get(), originalSize.size.x * originalSize.size.y * sizeof(float));
+        std::vector<std::unique_ptr<image_buffer<float, 1>>> filtered;
+        std::vector<image_view<const float, 1>> source(1, in.view());
+        for (size_t i = 1; i < levels(); ++i)
+        {
+            filtered.emplace_back(new image_buffer<float, 1>(level(int(i)).size));
+            source.push_back(filtered.back()->view());
+        }
 
-        for (int i = 1; i < levels(); ++i)
+        task_graph graph;
+        std::vector<size_t> ready; // the job that filtered the source of the current level, if any
+        for (size_t i = 0; i < levels(); ++i)
         {
-            downsample_half_box_filter(level(i - 1), level(i));
+            graph.add([this, &source, i]()
+            {
+                image_buffer<T, C> & l = level(int(i));
+                parallel_for(0, l.size.y, 64, [&](int y0, int y1)
+                {
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        const float * src = source[i].row_data(y);
+                        for (int x = 0; x < l.size.x; ++x) l(y, x) = stored_sample<T>(src[x]);
+                    }
+                });
+            }, ready);
+            if (i + 1 == levels()) break;
+
+            ready = { graph.add([&source, &filtered, i]() { downsample_half_box_filter(source[i], filtered[i]->view()); }, ready) };
         }
+        graph.run();
     }
 
-    size_t levels() const { return pyramid.size(); }
+    size_t levels() const override { return pyramid.size(); }
+
+    size_t size_bytes() const override
+    {
+        size_t bytes = 0;
+        for (auto & l : pyramid) bytes += l->size_bytes();
+        return bytes;
+    }
+
+    void upload(texture_buffer & buffer, const int l) override { upload_luminance(buffer, level(l)); }
 
     image_buffer<T, C> & level(const int level)
     {
@@ -276,6 +307,270 @@ public:
 
 };
 
+inline std::unique_ptr<display_pyramid> make_display_pyramid(const image_buffer<float, 1> & in, const spectrum_storage storage)
+{
+    switch (storage)
+    {
+    case spectrum_storage::float16: { auto p = new image_buffer_pyramid<half, 1>(in.size.x); p->build(in); return std::unique_ptr<display_pyramid>(p); }
+    case spectrum_storage::bfloat16: { auto p = new image_buffer_pyramid<bfloat16, 1>(in.size.x); p->build(in); return std::unique_ptr<display_pyramid>(p); }
+    default: { auto p = new image_buffer_pyramid<float, 1>(in.size.x); p->build(in); return std::unique_ptr<display_pyramid>(p); }
+    }
+}
+
+/////////////////////
+//   Batch Modes   //
+/////////////////////
+
+struct compare_pair
+{
+    std::string source;
+    std::string compressed;
+};
+
+inline std::string format_compare_row(const compare_pair & pair, const spectral_compare_result & r)
+{
+    std::string row = pair.source + "," + pair.compressed + "," + std::to_string(r.totalEnergyDb) + "," + std::to_string(r.blockHarmonicDb) + "," + std::to_string(r.blockHarmonicFraction);
+    for (auto db : r.octaveLossDb) row += "," + std::to_string(db);
+    return row;
+}
+
+// Pairs run concurrently on the shared pool; each pair's FFT passes nest inside the same pool
+int run_compare_batch(const std::vector<compare_pair> & pairs, const bool writeDiffImages)
+{
+    std::vector<std::string> rows(pairs.size());
+
+    parallel_for(0, (int)pairs.size(), 1, [&](int b, int e)
+    {
+        for (int i = b; i < e; ++i)
+        {
+            try
+            {
+                auto source = load_luminance(pairs[i].source);
+                auto compressed = load_luminance(pairs[i].compressed);
+                auto result = compare_spectra(source, compressed);
+                if (writeDiffImages) write_luminance_png(pairs[i].compressed + ".spectral_diff.png", *result.diffImage);
+                rows[i] = format_compare_row(pairs[i], result);
+            }
+            catch (const std::exception & e)
+            {
+                rows[i] = pairs[i].source + "," + pairs[i].compressed + ",error: " + e.what();
+            }
+        }
+    });
+
+    std::cout << "source,compressed,total_energy_db,block_harmonic_db,block_harmonic_fraction,octave_loss_db..." << std::endl;
+    for (auto & r : rows) std::cout << r << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Each non-empty line of the list file is "<source.png> <compressed.dds>"
+std::vector<compare_pair> read_compare_list(const std::string & path)
+{
+    std::vector<uint8_t> bytes = read_file_binary(path);
+    std::istringstream stream(std::string(bytes.begin(), bytes.end()));
+    std::vector<compare_pair> pairs;
+    compare_pair p;
+    while (stream >> p.source >> p.compressed) pairs.push_back(p);
+    return pairs;
+}
+
+// Translation of each second image relative to the first, as csv. Pairs are split into one contiguous run per
+// thread, each with its own correlator, so the transform buffers are allocated once per thread, not per pair.
+int run_register_batch(const std::vector<compare_pair> & pairs)
+{
+    std::vector<std::string> rows(pairs.size());
+    const int numThreads = (int)get_thread_pool().num_threads();
+    const int grain = std::max(1, ((int)pairs.size() + numThreads - 1) / numThreads);
+
+    parallel_for(0, (int)pairs.size(), grain, [&](int b, int e)
+    {
+        phase_correlator correlator(window_type::hann, false);
+        for (int i = b; i < e; ++i)
+        {
+            try
+            {
+                auto reference = load_luminance(pairs[i].source);
+                auto moved = load_luminance(pairs[i].compressed);
+                auto result = correlator.correlate(reference, moved);
+                std::ostringstream row;
+                row << pairs[i].source << "," << pairs[i].compressed << "," << result.shift.x << "," << result.shift.y << "," << result.peak;
+                rows[i] = row.str();
+            }
+            catch (const std::exception & e)
+            {
+                rows[i] = pairs[i].source + "," + pairs[i].compressed + ",error: " + e.what();
+            }
+        }
+    });
+
+    std::cout << "reference,moved,shift_x,shift_y,peak" << std::endl;
+    for (auto & r : rows) std::cout << r << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Per-layer / per-face statistics of an array texture or cubemap as csv, optionally with the tiled overview image
+int run_layer_batch(const std::string & path, const std::string & overviewPath)
+{
+    texture_container t(std::make_shared<const mapped_file>(path));
+    auto layers = analyze_texture_layers(t);
+
+    std::cout << "layer,face,mean,spectral_centroid,high_frequency_fraction,anisotropy,dominant_orientation_degrees" << std::endl;
+    for (auto & l : layers)
+    {
+        std::cout << l.layer << "," << l.face << "," << l.mean << "," << l.spectralCentroid << "," << l.highFrequencyFraction << "," << l.anisotropy << "," << l.dominantOrientation << std::endl;
+    }
+
+    if (!overviewPath.empty())
+    {
+        int columns;
+        auto overview = tile_layer_thumbnails(layers, columns);
+        write_luminance_png(overviewPath, overview);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Radially averaged 3D power spectrum as csv, optionally with the xy / xz / yz spectrum slices
+int run_volume_batch(const std::string & path, const std::string & slicePrefix)
+{
+    texture_container t(std::make_shared<const mapped_file>(path));
+    auto voxels = volume_to_luminance(t.view(0, 0, 0));
+    auto result = analyze_volume(voxels, t.extent);
+
+    std::cout << "radius_cycles_per_voxel,mean_power" << std::endl;
+    for (size_t i = 0; i < result.radialPower.size(); ++i)
+    {
+        std::cout << (i + 0.5f) * 0.5f / result.radialPower.size() << "," << result.radialPower[i] << std::endl;
+    }
+
+    if (!slicePrefix.empty())
+    {
+        write_luminance_png(slicePrefix + "_xy.png", *result.sliceXY);
+        write_luminance_png(slicePrefix + "_xz.png", *result.sliceXZ);
+        write_luminance_png(slicePrefix + "_yz.png", *result.sliceYZ);
+    }
+    return EXIT_SUCCESS;
+}
+
+void write_spectrum_csv(std::ostream & out, const spectrum_statistics & stats)
+{
+    out << "radius_cycles_per_pixel,mean_power,count" << std::endl;
+    for (size_t i = 0; i < stats.radialPower.size(); ++i)
+    {
+        out << radial_bin_frequency(stats, i) << "," << stats.radialPower[i] << "," << stats.radialCount[i] << std::endl;
+    }
+}
+
+// seamEnergy is only written when the statistics came from the periodic component
+void write_spectrum_json(std::ostream & out, const spectrum_statistics & stats, const float seamEnergy = -1.f)
+{
+    out << "{\n";
+    if (seamEnergy >= 0) out << "  \"seam_energy\": " << seamEnergy << ",\n";
+    out << "  \"total_power\": " << stats.totalPower << ",\n  \"spectral_centroid\": " << stats.spectralCentroid << ",\n  \"high_frequency_fraction\": " << stats.highFrequencyFraction;
+    out << ",\n  \"anisotropy\": " << stats.anisotropy << ",\n  \"dominant_orientation_degrees\": " << stats.dominantOrientation << ",\n  \"radial\": [";
+    for (size_t i = 0; i < stats.radialPower.size(); ++i)
+    {
+        out << (i ? "," : "") << "\n    { \"radius\": " << radial_bin_frequency(stats, i) << ", \"power\": " << stats.radialPower[i] << ", \"count\": " << stats.radialCount[i] << " }";
+    }
+    out << "\n  ],\n  \"angular\": [";
+    for (size_t i = 0; i < stats.angularPower.size(); ++i)
+    {
+        out << (i ? "," : "") << "\n    { \"degrees\": " << (i + 0.5f) * 180.f / stats.angularPower.size() << ", \"fraction\": " << stats.angularPower[i] << " }";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+// Radially averaged power spectrum of a single image, as csv or json on stdout. With periodic, the statistics
+// describe the periodic component and the json reports the seam energy that was removed. A non-zero
+// welchTileSize averages overlapping tiles of that size instead of transforming the whole image.
+int run_psd_batch(const std::string & path, const bool json, const bool periodic, const window_type window, const int welchTileSize)
+{
+    auto file = std::make_shared<const mapped_file>(path);
+    if (!periodic && window == window_type::none && welchTileSize == 0 && png_luminance_reader::supports(*file))
+    {
+        png_luminance_reader reader(file);
+        image_buffer<float, 1> img(reader.size());
+        auto spectrum = compute_spectrum_streaming(img, [&](int, float * row) { reader.read_row(row); });
+        auto stats = compute_spectrum_statistics(spectrum.data(), img.size);
+        if (json) write_spectrum_json(std::cout, stats);
+        else write_spectrum_csv(std::cout, stats);
+        return EXIT_SUCCESS;
+    }
+
+    auto img = decode_luminance(file);
+    periodic_spectrum spectrum;
+    int2 spectrumSize = img.size;
+    if (welchTileSize > 0)
+    {
+        spectrum.spectrum = compute_welch_spectrum(img, welchTileSize, window == window_type::none ? window_type::hann : window);
+        spectrumSize = { welchTileSize, welchTileSize };
+    }
+    else if (periodic) spectrum = compute_periodic_spectrum(img);
+    else spectrum.spectrum = compute_spectrum(img, window);
+
+    auto stats = compute_spectrum_statistics(spectrum.spectrum.data(), spectrumSize);
+    if (json) write_spectrum_json(std::cout, stats, periodic && welchTileSize == 0 ? spectrum.seamEnergy : -1.f);
+    else write_spectrum_csv(std::cout, stats);
+    return EXIT_SUCCESS;
+}
+
+// Same as run_psd_batch with no window, but the spectrum is transformed out of core through a scratch file so that
+// no more than budgetBytes of panels are held in RAM, and the statistics are gathered band by band.
+int run_out_of_core_psd_batch(const std::string & path, const bool json, const size_t budgetBytes, const std::string & scratchPath)
+{
+    // Pngs are decoded a row at a time as the transform asks for them, so the decoded image is never held either
+    auto file = std::make_shared<const mapped_file>(path);
+    std::unique_ptr<png_luminance_reader> reader;
+    std::unique_ptr<image_buffer<float, 1>> img;
+    if (png_luminance_reader::supports(*file)) reader.reset(new png_luminance_reader(file));
+    else img.reset(new image_buffer<float, 1>(decode_luminance(file)));
+    const int2 size = reader ? reader->size() : img->size;
+
+    out_of_core_spectrum spectrum(size, budgetBytes, scratchPath);
+    spectrum.compute([&](int y, float * row)
+    {
+        if (reader) reader->read_row(row);
+        else memcpy(row, &(*img)(y, 0), size.x * sizeof(float));
+    });
+
+    spectrum_statistics_accumulator accumulator(size);
+    spectrum.for_each_band([&](int y0, int rows, const std::complex<float> * band) { accumulator.add_rows(band, y0, rows); });
+
+    auto stats = accumulator.finish();
+    if (json) write_spectrum_json(std::cout, stats);
+    else write_spectrum_csv(std::cout, stats);
+    return EXIT_SUCCESS;
+}
+
+// Per-tile dominant frequency and high-frequency energy as csv, optionally with the high-frequency map as a png
+int run_local_map_batch(const std::string & path, const std::string & mapPath)
+{
+    auto img = load_luminance(path);
+    auto map = compute_local_spectrum_map(img);
+
+    std::cout << "tile_x,tile_y,dominant_frequency,high_frequency_fraction" << std::endl;
+    for (int y = 0; y < map.dominantFrequency->size.y; ++y)
+        for (int x = 0; x < map.dominantFrequency->size.x; ++x)
+            std::cout << x * map.step << "," << y * map.step << "," << (*map.dominantFrequency)(y, x) << "," << (*map.highFrequencyFraction)(y, x) << std::endl;
+
+    if (!mapPath.empty()) write_luminance_png(mapPath, *map.highFrequencyFraction);
+    return EXIT_SUCCESS;
+}
+
+// Gaussian blur, or an unsharp mask (source + amount * (source - blur)) when amount is non-zero
+int run_blur_batch(const std::string & path, const std::string & outputPath, const float sigma, const float sharpenAmount)
+{
+    auto img = load_luminance(path);
+    auto kernel = make_gaussian_kernel(sigma);
+    auto blurred = convolve(img, *kernel);
+
+    if (sharpenAmount != 0)
+    {
+        for (int i = 0; i < img.num_pixels(); ++i) blurred.alias[i] = img.alias[i] + sharpenAmount * (img.alias[i] - blurred.alias[i]);
+    }
+    write_luminance_png(outputPath, blurred);
+    return EXIT_SUCCESS;
+}
+
 //////////////////////////
 //   Main Application   //
 //////////////////////////
@@ -285,15 +580,83 @@ std::unique_ptr<Window> win;
 
 int main(int argc, char * argv[])
 {
+    // Batch modes run headless and exit
+    std::vector<std::string> args(argv + 1, argv + argc);
+    auto has_flag = [&](const char * flag) { return std::find(args.begin(), args.end(), flag) != args.end(); };
+    auto flag_value = [&](const char * flag, const char * fallback) -> std::string
+    {
+        auto it = std::find(args.begin(), args.end(), flag);
+        return (it != args.end() && it + 1 != args.end()) ? *(it + 1) : fallback;
+    };
+    const bool writeDiffImages = has_flag("--diff-images");
+    spectrum_storage storage = spectrum_storage::float32; // precision of the displayed mip chain, 'h' cycles it
+    try
+    {
+        storage = storage_from_name(flag_value("--storage", "fp32"));
+        if (args.size() >= 3 && args[0] == "--compare") return run_compare_batch({ { args[1], args[2] } }, writeDiffImages);
+        if (args.size() >= 2 && args[0] == "--compare-batch") return run_compare_batch(read_compare_list(args[1]), writeDiffImages);
+        if (args.size() >= 3 && args[0] == "--register") return run_register_batch({ { args[1], args[2] } });
+        if (args.size() >= 2 && args[0] == "--register-batch") return run_register_batch(read_compare_list(args[1]));
+        if (args.size() >= 2 && args[0] == "--psd" && has_flag("--budget")) return run_out_of_core_psd_batch(args[1], has_flag("--json"), size_t(std::stoull(flag_value("--budget", "0"))) << 20, flag_value("--scratch", (args[1] + ".scratch").c_str()));
+        if (args.size() >= 2 && args[0] == "--psd") return run_psd_batch(args[1], has_flag("--json"), has_flag("--periodic"), window_from_name(flag_value("--window", "none")), std::stoi(flag_value("--welch", "0")));
+        if (args.size() >= 4 && args[0] == "--blur") return run_blur_batch(args[1], args[2], std::stof(args[3]), 0.f);
+        if (args.size() >= 4 && args[0] == "--sharpen") return run_blur_batch(args[1], args[2], std::stof(args[3]), args.size() >= 5 ? std::stof(args[4]) : 1.f);
+        if (args.size() >= 2 && args[0] == "--local-map") return run_local_map_batch(args[1], args.size() >= 3 ? args[2] : "");
+        if (args.size() >= 2 && args[0] == "--volume") return run_volume_batch(args[1], args.size() >= 3 ? args[2] : "");
+        if (args.size() >= 2 && args[0] == "--layers") return run_layer_batch(args[1], args.size() >= 3 ? args[2] : "");
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "Batch error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
     bool should_take_screenshot = false;
-    std::unique_ptr<image_buffer_pyramid<float, 1>> pyramid;
+    std::unique_ptr<display_pyramid> pyramid;
 
     std::string status("No file currently loaded...");
 
+    // Set when an array texture or cubemap is shown as a tiled overview
+    std::vector<layer_spectrum> layerStats;
+    int layerColumns = 0;
+
+    // Shown as a line plot along the bottom of the window when non-empty
+    std::vector<float> plotValues;
+
+    // Statistics of the spectrum on screen, exported next to the source file with 'e'
+    spectrum_statistics spectrumStats;
+    std::string spectrumPath;
+
+    // 'p' toggles between the spectrum of the image and of its periodic component (Moisan), which drops the
+    // cross caused by the jumps between opposite borders. The source is kept so the toggle doesn't reload.
+    bool periodicMode = false;
+    window_type window = window_type::none; // 'w' cycles through the window functions
+    bool welchMode = false;                  // 't' averages the spectra of overlapping tiles instead
+
+    // 'm' cycles the source image with a local spectrum heatmap: off, high-frequency energy, dominant frequency
+    int localMapMode = 0;
+    std::unique_ptr<texture_buffer> heatmapTexture;
+    int2 heatmapCoverage = { 0, 0 }; // pixels of the source covered by the tile grid
+
+    // 'f' cycles the frequency filters: masked spectrum on the left, filtered image on the right. '[' and ']'
+    // move the cutoff; in notch mode clicking the spectrum adds a notch. The forward spectrum is kept, so
+    // each change only costs the mask multiply and the inverse transform.
+    std::unique_ptr<spectrum_filter> filter;
+    filter_params filterParams;
+    float2 cursor = { 0, 0 };
+    float seamEnergy = 0;
+    std::shared_ptr<image_buffer<float, 1>> sourceImage;
+
+    // Last plain (unwindowed, whole image) spectrum and the image it was computed from. Re-dropping an edited
+    // version of the same file only transforms the changed region and adds it in. Kept across drops.
+    std::string cachedPath;
+    std::shared_ptr<image_buffer<float, 1>> cachedImage;
+    std::vector<std::complex<float>> cachedSpectrum;
+
     auto loadMip = [&](const int level)
     {
-        if (!loadedTexture.get()) return;
-        upload_luminance(*loadedTexture.get(), pyramid->level(level));
+        if (!loadedTexture.get() || !pyramid) return;
+        pyramid->upload(*loadedTexture.get(), level);
     };
 
     try
@@ -305,6 +668,107 @@ int main(int argc, char * argv[])
         std::cout << "Caught GLFW window exception: " << e.what() << std::endl;
     }
 
+    // streamedSpectrum is the plain spectrum when it was already computed while decoding
+    auto showSpectrum = [&](image_buffer<float, 1> & img, const std::string & path, std::vector<std::complex<float>> * streamedSpectrum = nullptr)
+    {
+        const int welchTileSize = 256;
+        if (welchMode ? (img.size.x < welchTileSize || img.size.y < welchTileSize) : (!is_power_of_two(img.size.x) || !is_power_of_two(img.size.y)))
+        {
+            status = welchMode ? "Image is smaller than a welch tile" : "Image size is not a power of two";
+            return false;
+        }
+
+        sourceImage = std::make_shared<image_buffer<float, 1>>(img);
+        heatmapTexture.reset();
+        localMapMode = 0;
+        filterParams.type = filter_type::none;
+        std::vector<std::complex<float>> imgAsComplexArray;
+        std::string updateNote;
+        const int2 spectrumSize = welchMode ? int2(welchTileSize, welchTileSize) : img.size;
+
+        // Resize window
+        int2 existingWindowSize = win->get_window_size();
+        int2 newWindowSize = int2(std::max(existingWindowSize.x, spectrumSize.x), std::max(existingWindowSize.y, spectrumSize.y));
+        win->set_window_size(newWindowSize);
+
+        if (welchMode)
+        {
+            imgAsComplexArray = compute_welch_spectrum(img, welchTileSize, window == window_type::none ? window_type::hann : window);
+        }
+        else if (periodicMode)
+        {
+            auto periodic = compute_periodic_spectrum(img);
+            seamEnergy = periodic.seamEnergy;
+            imgAsComplexArray = std::move(periodic.spectrum);
+        }
+        else if (window == window_type::none)
+        {
+            if (cachedImage && cachedPath == path && cachedImage->size == img.size)
+            {
+                const auto region = update_spectrum(cachedSpectrum, *cachedImage, img);
+                if (!region.empty()) updateNote = ", updated " + std::to_string(region.size().x) + "x" + std::to_string(region.size().y) + " region";
+            }
+            else if (streamedSpectrum) cachedSpectrum = std::move(*streamedSpectrum);
+            else cachedSpectrum = compute_spectrum(img);
+
+            cachedPath = path;
+            cachedImage = sourceImage;
+            imgAsComplexArray = cachedSpectrum;
+        }
+        else
+        {
+            imgAsComplexArray = compute_spectrum(img, window);
+        }
+
+        spectrumStats = compute_spectrum_statistics(imgAsComplexArray.data(), spectrumSize);
+        plotValues = spectrumStats.radialPower;
+
+        // Convert back to image type & normalize range
+        image_buffer<float, 1> magnitude(spectrumSize);
+        for (int i = 0; i < magnitude.num_pixels(); i++) magnitude.alias[i] = std::abs(imgAsComplexArray[i]);
+
+        const sample_statistics range = reduce_samples(magnitude.alias, magnitude.num_pixels());
+        for (int i = 0; i < magnitude.num_pixels(); i++) magnitude.alias[i] = ((magnitude.alias[i] - range.min) / (range.max - range.min)) * 64.f;
+
+        // Move zero-frequency to the center
+        image_buffer<float, 1> centered(spectrumSize);
+        center_fft_image(magnitude, centered);
+
+        pyramid = make_display_pyramid(centered, storage); // todo: validate square
+
+        loadedTexture->size = spectrumSize;
+        pyramid->upload(*loadedTexture.get(), 0);
+
+        spectrumPath = path;
+        status = path + " - anisotropy " + std::to_string(spectrumStats.anisotropy).substr(0, 4) + " at " + std::to_string(int(spectrumStats.dominantOrientation + 0.5f)) + " deg";
+        if (periodicMode && !welchMode) status += ", periodic component, seam energy " + std::to_string(seamEnergy).substr(0, 5);
+        else if (welchMode) status += ", welch " + std::to_string(welchTileSize) + "^2 tiles, " + std::string(window_name(window == window_type::none ? window_type::hann : window)) + " window";
+        else if (window != window_type::none) status += ", " + std::string(window_name(window)) + " window";
+        status += updateNote;
+        if (storage != spectrum_storage::float32) status += ", " + std::string(storage_name(storage)) + " display " + std::to_string(pyramid->size_bytes() >> 20) + " MB";
+        return true;
+    };
+
+    auto showFiltered = [&]()
+    {
+        if (!filter) filter.reset(new spectrum_filter(*sourceImage));
+
+        image_buffer<float, 1> maskedSpectrum(sourceImage->size);
+        auto filtered = filter->apply(filterParams, &maskedSpectrum);
+        auto panels = concat_horizontal({ &maskedSpectrum, &filtered });
+
+        pyramid.reset();
+        plotValues.clear();
+        heatmapTexture.reset();
+        loadedTexture->size = panels.size;
+        upload_luminance(*loadedTexture.get(), panels);
+        win->set_window_size(int2(std::max(win->get_window_size().x, panels.size.x), std::max(win->get_window_size().y, panels.size.y)));
+
+        status = spectrumPath + " - " + filter_name(filterParams.type);
+        if (filterParams.type == filter_type::notch) status += ", " + std::to_string(filterParams.notches.size()) + " notches (click the spectrum to add)";
+        else status += " at " + std::to_string(filterParams.cutoff).substr(0, 6) + " cycles/px";
+    };
+
     win->on_key = [&](int key, int action, int mods)
     {
         if (key == ' ' && action == GLFW_RELEASE) should_take_screenshot = true;
@@ -317,85 +781,205 @@ int main(int argc, char * argv[])
         if (key == '7' && action == GLFW_RELEASE) loadMip(6);
         if (key == '8' && action == GLFW_RELEASE) loadMip(7);
         if (key == '9' && action == GLFW_RELEASE) loadMip(8);
+        if (key == 'E' && action == GLFW_RELEASE && !spectrumPath.empty())
+        {
+            std::ofstream csv(spectrumPath + ".psd.csv"), json(spectrumPath + ".psd.json");
+            write_spectrum_csv(csv, spectrumStats);
+            write_spectrum_json(json, spectrumStats);
+            status = "Exported " + spectrumPath + ".psd.csv / .json";
+        }
+        if (key == 'P' && action == GLFW_RELEASE && sourceImage)
+        {
+            periodicMode = !periodicMode;
+            image_buffer<float, 1> img(*sourceImage);
+            showSpectrum(img, spectrumPath);
+        }
+        if (key == 'T' && action == GLFW_RELEASE && sourceImage)
+        {
+            welchMode = !welchMode;
+            image_buffer<float, 1> img(*sourceImage);
+            showSpectrum(img, spectrumPath);
+        }
+        if (key == 'M' && action == GLFW_RELEASE && sourceImage)
+        {
+            localMapMode = (localMapMode + 1) % 3;
+            image_buffer<float, 1> img(*sourceImage);
+            if (localMapMode == 0)
+            {
+                heatmapTexture.reset();
+                showSpectrum(img, spectrumPath);
+                return;
+            }
+
+            auto map = compute_local_spectrum_map(img);
+            pyramid.reset();
+            plotValues.clear();
+            loadedTexture->size = img.size;
+            upload_luminance(*loadedTexture.get(), img);
+
+            // Dominant frequency spans 0 to the corner of the spectrum, sqrt(2) / 2 cycles/px
+            if (localMapMode == 2) for (int i = 0; i < map.dominantFrequency->num_pixels(); ++i) map.dominantFrequency->alias[i] *= std::sqrt(2.f);
+            heatmapTexture.reset(new texture_buffer());
+            upload_heatmap(*heatmapTexture.get(), localMapMode == 1 ? *map.highFrequencyFraction : *map.dominantFrequency);
+            heatmapCoverage = (heatmapTexture->size - int2(1, 1)) * map.step + int2(map.tileSize, map.tileSize);
+            status = spectrumPath + (localMapMode == 1 ? " - high-frequency energy per " : " - dominant frequency per ") + std::to_string(map.tileSize) + "^2 tile";
+        }
+        if (key == 'F' && action == GLFW_RELEASE && sourceImage)
+        {
+            filterParams.type = filter_type((int(filterParams.type) + 1) % (int(filter_type::notch) + 1));
+            if (filterParams.type == filter_type::none)
+            {
+                image_buffer<float, 1> img(*sourceImage);
+                showSpectrum(img, spectrumPath);
+            }
+            else showFiltered();
+        }
+        if ((key == '[' || key == ']') && action != GLFW_RELEASE && filter && filterParams.type != filter_type::none)
+        {
+            filterParams.cutoff = clamp(filterParams.cutoff * (key == ']' ? 1.189207f : 1 / 1.189207f), 1.f / 1024, 0.5f); // quarter octave steps
+            showFiltered();
+        }
+        if (key == 'W' && action == GLFW_RELEASE && sourceImage)
+        {
+            window = window_type((int(window) + 1) % (int(window_type::tukey) + 1));
+            periodicMode = false;
+            image_buffer<float, 1> img(*sourceImage);
+            showSpectrum(img, spectrumPath);
+        }
+        if (key == 'H' && action == GLFW_RELEASE && sourceImage)
+        {
+            storage = spectrum_storage((int(storage) + 1) % (int(spectrum_storage::bfloat16) + 1));
+            image_buffer<float, 1> img(*sourceImage);
+            showSpectrum(img, spectrumPath);
+        }
+    };
+
+    win->on_cursor_pos = [&](float2 pos) { cursor = pos; };
+
+    win->on_mouse_button = [&](int button, int action, int mods)
+    {
+        if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_RELEASE || !filter || filterParams.type != filter_type::notch) return;
+        const int2 size = sourceImage->size;
+        if (cursor.x >= size.x || cursor.y >= size.y) return;
+        filterParams.notches.push_back(float2((cursor.x - size.x / 2) / size.x, (cursor.y - size.y / 2) / size.y));
+        showFiltered();
     };
 
     win->on_drop = [&](int numFiles, const char ** paths)
     {
-        for (int f = 0; f < numFiles; f++)
+        // Dropping a master and its compressed version together shows the difference of their log spectra
+        if (numFiles == 2)
         {
-            std::vector<uint8_t> data;
-            loadedTexture.reset(new texture_buffer()); // gen handle
-            const std::string fileExtension = get_extension(paths[f]);
-            status = paths[f];
-
             try
             {
-                data = read_file_binary(std::string(paths[f]));
+                // The compressed file is whichever one isn't a png or hdr master, told apart by magic bytes
+                auto is_master = [](const mapped_file & f)
+                {
+                    const container_format c = detect_container(f.data(), f.size());
+                    return c == container_format::png || c == container_format::hdr;
+                };
+                auto sourceFile = std::make_shared<const mapped_file>(paths[0]);
+                auto compressedFile = std::make_shared<const mapped_file>(paths[1]);
+                if (!is_master(*sourceFile) && is_master(*compressedFile)) std::swap(sourceFile, compressedFile);
+
+                auto source = decode_luminance(sourceFile);
+                auto compressed = decode_luminance(compressedFile);
+                auto result = compare_spectra(source, compressed);
+
+                pyramid = make_display_pyramid(*result.diffImage, storage);
+
+                loadedTexture.reset(new texture_buffer());
+                loadedTexture->size = result.diffImage->size;
+                pyramid->upload(*loadedTexture.get(), 0);
+
+                status = "block harmonics " + std::to_string(result.blockHarmonicDb) + " dB, octave loss (high to low):";
+                for (auto db : result.octaveLossDb) status += " " + std::to_string(db);
             }
             catch (const std::exception & e)
             {
-                status = std::string("Couldn't read file: ") + e.what();
+                status = std::string("Couldn't compare files: ") + e.what();
             }
+            return;
+        }
 
-            if (fileExtension == "png" || fileExtension == "PNG")
-            {
-                auto img = png_to_luminance(data);
-
-                if (!is_power_of_two(img.size.x) || !is_power_of_two(img.size.y))
-                {
-                    status = "Image size is not a power of two";
-                    return;
-                }
-
-                // Resize window
-                int2 existingWindowSize = win->get_window_size();
-                int2 newWindowSize = int2(std::max(existingWindowSize.x, img.size.x), std::max(existingWindowSize.y, img.size.y));
-                win->set_window_size(newWindowSize);
+        layerStats.clear();
+        plotValues.clear();
+        spectrumPath.clear();
+        sourceImage.reset();
+        heatmapTexture.reset();
+        localMapMode = 0;
+        filter.reset();
+        filterParams = filter_params();
 
-                float mean = img.compute_mean();
-                std::vector<std::complex<float>>imgAsComplexArray(img.size.x * img.size.y);
+        for (int f = 0; f < numFiles; f++)
+        {
+            loadedTexture.reset(new texture_buffer()); // gen handle
+            status = paths[f];
 
-                for (int y = 0; y < img.size.y; y++)
-                    for (int x = 0; x < img.size.x; x++)
-                        imgAsComplexArray[y * img.size.x + x] = img(y, x) - mean;
+            try
+            {
+                auto file = std::make_shared<const mapped_file>(std::string(paths[f]));
+                const container_format container = detect_container(file->data(), file->size());
 
-                compute_fft_2d(imgAsComplexArray.data(), img.size);
+                // Plain spectra of new pngs are computed while the rows decode; re-drops use the incremental update
+                png_header header;
+                const bool streamPng = !welchMode && !periodicMode && window == window_type::none && cachedPath != paths[f] && png_luminance_reader::supports(*file) &&
+                    png_read_header(file->data(), file->size(), header) && is_power_of_two(header.width) && is_power_of_two(header.height);
 
-                float min = std::abs(imgAsComplexArray[0]), max = min;
-                for (int i = 0; i < img.size.x * img.size.y; i++) 
+                if (streamPng)
                 {
-                    float value = std::abs(imgAsComplexArray[i]);
-                    min = std::min(min, value);
-                    max = std::max(max, value);
+                    png_luminance_reader reader(file);
+                    image_buffer<float, 1> img(reader.size());
+                    auto spectrum = compute_spectrum_streaming(img, [&](int, float * row) { reader.read_row(row); });
+                    showSpectrum(img, paths[f], &spectrum);
                 }
-
-                // Convert back to image type & normalize range
-                for (int y = 0; y < img.size.y; y++)
+                else if (container == container_format::png || container == container_format::hdr)
+                {
+                    auto img = decode_luminance(file);
+                    showSpectrum(img, paths[f]);
+                }
+                else if (container == container_format::dds || container == container_format::ktx || container == container_format::kmg)
                 {
-                    for (int x = 0; x < img.size.x; x++)
+                    // Float textures (heightmaps, displacement) are analyzed at full precision, everything else is displayed as-is
+                    texture_container t(file);
+                    if (t.extent.z > 1)
+                    {
+                        // Volume: xy / xz / yz slices through the DC voxel, plus the radially averaged 3D power spectrum
+                        auto voxels = volume_to_luminance(t.view(0, 0, 0));
+                        auto result = analyze_volume(voxels, t.extent);
+                        auto slices = concat_horizontal({ result.sliceXY.get(), result.sliceXZ.get(), result.sliceYZ.get() });
+                        pyramid.reset();
+                        loadedTexture->size = slices.size;
+                        upload_luminance(*loadedTexture.get(), slices);
+                        plotValues = result.radialPower;
+                        win->set_window_size(int2(std::max(win->get_window_size().x, slices.size.x), std::max(win->get_window_size().y, slices.size.y + 160)));
+                        status = std::string(paths[f]) + " - slices xy | xz | yz";
+                    }
+                    else if (t.layers * t.faces > 1)
+                    {
+                        layerStats = analyze_texture_layers(t);
+                        auto overview = tile_layer_thumbnails(layerStats, layerColumns);
+                        pyramid.reset();
+                        loadedTexture->size = overview.size;
+                        upload_luminance(*loadedTexture.get(), overview);
+                        win->set_window_size(int2(std::max(win->get_window_size().x, overview.size.x), std::max(win->get_window_size().y, overview.size.y)));
+                        status = std::string(paths[f]) + " - " + std::to_string(t.layers) + " layers, " + std::to_string(t.faces) + " faces";
+                    }
+                    else if (gli::is_float(t.format))
                     {
-                        const auto v = imgAsComplexArray[y * img.size.x + x];
-                        img(y, x) = ((std::sqrt((v.real() * v.real()) + (v.imag() * v.imag())) - min) / (max - min)) * 64.f;
+                        auto img = texture_to_luminance(t.view(0, 0, 0));
+                        showSpectrum(img, paths[f]);
                     }
+                    else upload_dds(*loadedTexture.get(), t);
+                }
+                else
+                {
+                    status = "Unsupported file format";
                 }
-
-                // Move zero-frequency to the center
-                image_buffer<float, 1> centered(img.size);
-                center_fft_image(img, centered);
-
-                pyramid.reset(new image_buffer_pyramid<float, 1>(img.size.x)); // todo: validate square
-                pyramid->build(centered);
-
-                loadedTexture->size = { img.size.x, img.size.y };
-                upload_luminance(*loadedTexture.get(), pyramid->level(0));
-            }
-            else if (fileExtension == "dds")
-            {
-                upload_dds(*loadedTexture.get(), data);
             }
-            else
+            catch (const std::exception & e)
             {
-                status = "Unsupported file format";
+                status = std::string("Couldn't load file: ") + e.what();
             }
         }
     };
@@ -422,6 +1006,31 @@ int main(int argc, char * argv[])
             draw_texture_buffer(0, 0, loadedTexture->size.x, loadedTexture->size.y, *loadedTexture.get());
         }
 
+        if (heatmapTexture.get() && loadedTexture.get())
+        {
+            // Tiles that don't fit the grid leave the bottom and right edges uncovered
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            draw_texture_buffer(0, 0, float(heatmapCoverage.x), float(heatmapCoverage.y), *heatmapTexture.get());
+            glDisable(GL_BLEND);
+        }
+
+        if (!plotValues.empty() && loadedTexture.get())
+        {
+            draw_plot(10, windowSize.y - 150.f, std::min(windowSize.x - 20.f, 512.f), 140, plotValues, true);
+        }
+
+        if (!layerStats.empty())
+        {
+            const int2 tile = layerStats[0].thumbnail->size;
+            for (size_t i = 0; i < layerStats.size(); ++i)
+            {
+                const auto & l = layerStats[i];
+                const std::string label = "L" + std::to_string(l.layer) + " F" + std::to_string(l.face) + " hf " + std::to_string(l.highFrequencyFraction).substr(0, 5);
+                draw_text(int(i % layerColumns) * tile.x + 4, int(i / layerColumns) * tile.y + tile.y - 6, label.c_str());
+            }
+        }
+
         if (should_take_screenshot)
         {
             should_take_screenshot = take_screenshot(loadedTexture->size);
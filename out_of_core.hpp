@@ -0,0 +1,164 @@
+#ifndef out_of_core_hpp
+#define out_of_core_hpp
+
+#include <vector>
+#include <complex>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include "util.hpp"
+#include "fft.hpp"
+#include "thread_pool.hpp"
+
+//////////////////////////////
+//   Out-of-Core Spectrum   //
+//////////////////////////////
+
+// Mean-subtracted 2D spectrum (as from compute_spectrum with no window) of an image too large to transform in
+// memory. The complex data lives in a mapped scratch file; RAM only ever holds two panels of the memory budget:
+//  - row pass: panels of whole rows are produced, transformed along x and written into the file, the next panel
+//    being produced as a pool job while the current one is transformed;
+//  - column pass: panels of adjacent columns are gathered from every row of the file, transformed along y and
+//    scattered back, the next panel being gathered while the current one is transformed.
+// Each row of a column panel is one contiguous run of the file, so the panel pass reads it without a transpose.
+class out_of_core_spectrum
+{
+    int2 size;
+    int rowsPerPanel, columnsPerPanel;
+    mapped_scratch_file scratch;
+
+    size_t row_bytes() const { return size_t(size.x) * sizeof(std::complex<float>); }
+
+    mapped_scratch_file::view map_rows(const int y0, const int rows) const
+    {
+        return scratch.map(size_t(y0) * row_bytes(), size_t(rows) * row_bytes());
+    }
+
+    // Copies (or with toFile, writes back) columns [x0, x0 + count) of every row, one band of rows per mapping
+    void transfer_columns(std::complex<float> * panel, const int x0, const int count, const bool toFile) const
+    {
+        for (int y0 = 0; y0 < size.y; y0 += rowsPerPanel)
+        {
+            const int rows = std::min(rowsPerPanel, size.y - y0);
+            auto band = map_rows(y0, rows);
+            auto * file = reinterpret_cast<std::complex<float> *>(band.data()) + x0;
+            for (int r = 0; r < rows; ++r)
+            {
+                std::complex<float> * ram = panel + size_t(y0 + r) * count;
+                if (toFile) memcpy(file + size_t(r) * size.x, ram, count * sizeof(std::complex<float>));
+                else memcpy(ram, file + size_t(r) * size.x, count * sizeof(std::complex<float>));
+            }
+        }
+    }
+
+public:
+
+    // memoryBudget bounds the panels held in RAM (in bytes). It has to fit two rows and two columns.
+    out_of_core_spectrum(const int2 size, const size_t memoryBudget, const std::string & scratchPath) :
+        size(size),
+        rowsPerPanel(int(std::min<size_t>(size.y, memoryBudget / (2 * size_t(size.x) * sizeof(std::complex<float>))))),
+        columnsPerPanel(int(std::min<size_t>(size.x, memoryBudget / (2 * size_t(size.y) * sizeof(std::complex<float>))))),
+        scratch(scratchPath, size_t(size.x) * size.y * sizeof(std::complex<float>))
+    {
+        if (rowsPerPanel < 1 || columnsPerPanel < 1) throw std::runtime_error("memory budget is too small for the image dimensions");
+    }
+
+    int rows_per_panel() const { return rowsPerPanel; }
+    int columns_per_panel() const { return columnsPerPanel; }
+
+    // produceRow(y, row) writes the size.x samples of row y. Rows are requested in order, one at a time.
+    void compute(const std::function<void(int, float *)> & produceRow)
+    {
+        const int width = size.x, height = size.y;
+        auto xFFT = get_fft_plan_cache().get(width, false);
+        auto yFFT = get_fft_plan_cache().get(height, false);
+
+        // Row pass
+        {
+            std::vector<std::complex<float>> panels[2];
+            for (auto & p : panels) p.resize(size_t(rowsPerPanel) * width);
+            const int numPanels = (height + rowsPerPanel - 1) / rowsPerPanel;
+
+            // The mean of the first panel stands in for the image mean, keeping the large DC out of the row transforms
+            float offset = 0;
+            auto produce = [&](const int p)
+            {
+                std::vector<float> row(width);
+                std::complex<float> * panel = panels[p % 2].data();
+                for (int y = p * rowsPerPanel, y1 = std::min(height, y + rowsPerPanel); y < y1; ++y)
+                {
+                    produceRow(y, row.data());
+                    std::complex<float> * dst = panel + size_t(y - p * rowsPerPanel) * width;
+                    for (int x = 0; x < width; ++x) dst[x] = row[x] - offset;
+                }
+            };
+
+            produce(0);
+            {
+                const size_t count = size_t(std::min(rowsPerPanel, height)) * width;
+                offset = float(reduce_samples(reinterpret_cast<const float *>(panels[0].data()), count, 2).mean); // real parts
+                for (size_t i = 0; i < count; ++i) panels[0][i] -= offset;
+            }
+
+            for (int p = 0; p < numPanels; ++p)
+            {
+                thread_pool::task next;
+                if (p + 1 < numPanels) next = get_thread_pool().async(std::bind(produce, p + 1));
+
+                const int y0 = p * rowsPerPanel, rows = std::min(rowsPerPanel, height - y0);
+                std::complex<float> * panel = panels[p % 2].data();
+                parallel_for(0, rows, 16, [&](int r0, int r1)
+                {
+                    xFFT->transform_batch(panel + size_t(r0) * width, r1 - r0, width);
+                });
+                memcpy(map_rows(y0, rows).data(), panel, size_t(rows) * row_bytes());
+
+                next.wait();
+            }
+        }
+
+        // Column pass
+        {
+            std::vector<std::complex<float>> panels[2];
+            for (auto & p : panels) p.resize(size_t(columnsPerPanel) * height);
+            const int numPanels = (width + columnsPerPanel - 1) / columnsPerPanel;
+
+            auto gather = [&](const int p)
+            {
+                const int x0 = p * columnsPerPanel;
+                transfer_columns(panels[p % 2].data(), x0, std::min(columnsPerPanel, width - x0), false);
+            };
+
+            gather(0);
+            for (int p = 0; p < numPanels; ++p)
+            {
+                thread_pool::task next;
+                if (p + 1 < numPanels) next = get_thread_pool().async(std::bind(gather, p + 1));
+
+                const int x0 = p * columnsPerPanel, columns = std::min(columnsPerPanel, width - x0);
+                std::complex<float> * panel = panels[p % 2].data();
+                parallel_for(0, columns, 16, [&](int c0, int c1)
+                {
+                    yFFT->transform_batch(panel + c0, c1 - c0, 1, columns);
+                });
+                if (p == 0) panel[0] = 0; // the mean is removed
+                transfer_columns(panel, x0, columns, true);
+
+                next.wait();
+            }
+        }
+    }
+
+    // Reads the spectrum back in bands of whole rows: fn(firstRow, rowCount, rows)
+    void for_each_band(const std::function<void(int, int, const std::complex<float> *)> & fn) const
+    {
+        for (int y0 = 0; y0 < size.y; y0 += rowsPerPanel)
+        {
+            const int rows = std::min(rowsPerPanel, size.y - y0);
+            auto band = map_rows(y0, rows);
+            fn(y0, rows, reinterpret_cast<const std::complex<float> *>(band.data()));
+        }
+    }
+};
+
+#endif // end out_of_core_hpp
@@ -0,0 +1,428 @@
+#ifndef png_decode_hpp
+#define png_decode_hpp
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+#include "util.hpp"
+
+////////////////////////////
+//   Minimal PNG Reader   //
+////////////////////////////
+
+// stb_image 2.08 reduces 16-bit pngs to 8 bits on load. This reader only handles what stb can't:
+// non-interlaced 16-bit greyscale / grey+alpha / rgb / rgba, returned as native-endian samples.
+
+struct png_header
+{
+    int width = 0;
+    int height = 0;
+    int bitDepth = 0;
+    int colorType = 0;
+    int interlace = 0;
+
+    int channels() const
+    {
+        switch (colorType)
+        {
+        case 0: return 1;
+        case 2: return 3;
+        case 3: return 1;
+        case 4: return 2;
+        case 6: return 4;
+        default: return 0;
+        }
+    }
+};
+
+inline uint32_t png_read_u32(const uint8_t * p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline bool png_has_signature(const uint8_t * data, const size_t size)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    return size >= 8 && std::memcmp(data, signature, 8) == 0;
+}
+
+// Returns false if the data is not a png
+inline bool png_read_header(const uint8_t * data, const size_t size, png_header & header)
+{
+    if (size < 33 || !png_has_signature(data, size) || std::memcmp(data + 12, "IHDR", 4) != 0) return false;
+    header.width = (int)png_read_u32(data + 16);
+    header.height = (int)png_read_u32(data + 20);
+    header.bitDepth = data[24];
+    header.colorType = data[25];
+    header.interlace = data[28];
+    return true;
+}
+
+inline int png_paeth(const int a, const int b, const int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Reverses the per-scanline filter in place. `row` and `prior` are stride bytes; prior is null for the first row.
+// The first pixel has no left neighbour, so each filter is one short loop over it and one over the rest.
+inline void png_unfilter_row(const int filter, uint8_t * row, const uint8_t * prior, const int stride, const int bytesPerPixel)
+{
+    const int n = bytesPerPixel;
+    switch (filter)
+    {
+    case 0: break;
+    case 1:
+        for (int i = n; i < stride; ++i) row[i] = uint8_t(row[i] + row[i - n]);
+        break;
+    case 2:
+        if (prior) for (int i = 0; i < stride; ++i) row[i] = uint8_t(row[i] + prior[i]);
+        break;
+    case 3:
+        if (prior)
+        {
+            for (int i = 0; i < n; ++i) row[i] = uint8_t(row[i] + (prior[i] >> 1));
+            for (int i = n; i < stride; ++i) row[i] = uint8_t(row[i] + ((row[i - n] + prior[i]) >> 1));
+        }
+        else for (int i = n; i < stride; ++i) row[i] = uint8_t(row[i] + (row[i - n] >> 1));
+        break;
+    case 4:
+        // With no prior row paeth always picks the left neighbour, same as filter 1
+        if (prior)
+        {
+            for (int i = 0; i < n; ++i) row[i] = uint8_t(row[i] + prior[i]);
+            for (int i = n; i < stride; ++i) row[i] = uint8_t(row[i] + png_paeth(row[i - n], prior[i], prior[i - n]));
+        }
+        else for (int i = n; i < stride; ++i) row[i] = uint8_t(row[i] + row[i - n]);
+        break;
+    default: throw std::runtime_error("corrupt png filter type");
+    }
+}
+
+////////////////////////
+//   Streaming Reader   //
+////////////////////////
+
+// Resumable DEFLATE decoder (RFC 1951) in the style of zlib's puff: read() decodes only as many bytes as asked
+// for and keeps the 32 KB history window between calls, so an image is decoded one scanline at a time without
+// ever holding the whole inflated stream. Input is the list of IDAT payloads, read in place.
+class inflate_stream
+{
+    // Canonical huffman code. Codes of up to fastBits are resolved with one table lookup (length << 9 | symbol,
+    // 0 when the code is longer); the rest are walked bit by bit from the code counts, as puff does.
+    struct huffman
+    {
+        static const int fastBits = 9;
+        uint16_t fast[1 << fastBits];
+        uint16_t count[16];
+        uint16_t symbol[288];
+
+        void build(const uint8_t * lengths, const int n)
+        {
+            std::memset(fast, 0, sizeof(fast));
+            std::memset(count, 0, sizeof(count));
+            for (int i = 0; i < n; ++i) count[lengths[i]]++;
+            count[0] = 0;
+
+            int left = 1;
+            for (int len = 1; len < 16; ++len)
+            {
+                left = (left << 1) - count[len];
+                if (left < 0) throw std::runtime_error("corrupt png huffman table");
+            }
+
+            uint16_t offsets[16], next[16];
+            offsets[1] = 0;
+            for (int len = 1; len < 15; ++len) offsets[len + 1] = uint16_t(offsets[len] + count[len]);
+            for (int i = 0; i < n; ++i) if (lengths[i]) symbol[offsets[lengths[i]]++] = uint16_t(i);
+
+            // Codes are assigned in increasing order per length but stored in the stream most significant bit first
+            int code = 0;
+            for (int len = 1; len < 16; ++len) { code = (code + count[len - 1]) << 1; next[len] = uint16_t(code); }
+            for (int i = 0; i < n; ++i)
+            {
+                const int len = lengths[i];
+                if (!len || len > fastBits) continue;
+                int reversed = 0;
+                for (int b = 0, c = next[len]++; b < len; ++b, c >>= 1) reversed = (reversed << 1) | (c & 1);
+                for (int k = reversed; k < (1 << fastBits); k += 1 << len) fast[k] = uint16_t((len << 9) | i);
+            }
+        }
+    };
+
+    std::vector<std::pair<const uint8_t *, size_t>> chunks;
+    size_t chunk = 0, position = 0;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0, padding = 0;
+
+    enum class block { header, stored, compressed, done } state = block::header;
+    bool lastBlock = false;
+    int storedRemaining = 0, matchRemaining = 0, matchDistance = 0;
+    huffman literals, distances;
+
+    std::vector<uint8_t> window;
+    size_t total = 0;
+
+    int next_byte()
+    {
+        while (chunk < chunks.size() && position == chunks[chunk].second) { ++chunk; position = 0; }
+        if (chunk < chunks.size()) return chunks[chunk].first[position++];
+        if (++padding > 8) throw std::runtime_error("truncated png zlib stream"); // zeros past the end only feed lookahead
+        return 0;
+    }
+
+    // Tops the bit buffer up to at least 57 bits, so most symbols decode without touching the input
+    void fill(const int n)
+    {
+        if (bitCount >= n) return;
+        while (bitCount <= 56)
+        {
+            const int v = chunk < chunks.size() && position < chunks[chunk].second ? chunks[chunk].first[position++] : next_byte();
+            bitBuffer |= uint64_t(v) << bitCount;
+            bitCount += 8;
+        }
+    }
+
+    int bits(const int n)
+    {
+        fill(n);
+        const int v = int(bitBuffer & ((uint64_t(1) << n) - 1));
+        bitBuffer >>= n;
+        bitCount -= n;
+        return v;
+    }
+
+    int decode(const huffman & h)
+    {
+        fill(16);
+        const int entry = h.fast[bitBuffer & ((1 << huffman::fastBits) - 1)];
+        if (entry)
+        {
+            bitBuffer >>= entry >> 9;
+            bitCount -= entry >> 9;
+            return entry & 511;
+        }
+
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16; ++len)
+        {
+            code |= int(bitBuffer & 1);
+            bitBuffer >>= 1;
+            bitCount--;
+            const int count = h.count[len];
+            if (code - count < first) return h.symbol[index + (code - first)];
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("corrupt png huffman code");
+    }
+
+    void read_block_header()
+    {
+        if (lastBlock) { state = block::done; return; }
+        lastBlock = bits(1) != 0;
+        const int type = bits(2);
+        if (type == 0)
+        {
+            bits(bitCount & 7); // stored blocks start on a byte boundary
+            const int length = bits(16), complement = bits(16);
+            if (length != (~complement & 0xffff)) throw std::runtime_error("corrupt png stored block");
+            storedRemaining = length;
+            state = block::stored;
+        }
+        else if (type == 1)
+        {
+            uint8_t lengths[288 + 32];
+            for (int i = 0; i < 144; ++i) lengths[i] = 8;
+            for (int i = 144; i < 256; ++i) lengths[i] = 9;
+            for (int i = 256; i < 280; ++i) lengths[i] = 7;
+            for (int i = 280; i < 288; ++i) lengths[i] = 8;
+            for (int i = 288; i < 320; ++i) lengths[i] = 5;
+            literals.build(lengths, 288);
+            distances.build(lengths + 288, 30);
+            state = block::compressed;
+        }
+        else if (type == 2)
+        {
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            const int numLiterals = bits(5) + 257, numDistances = bits(5) + 1, numCodeLengths = bits(4) + 4;
+            if (numLiterals > 286 || numDistances > 30) throw std::runtime_error("corrupt png block header");
+
+            uint8_t lengths[288 + 32] = {};
+            for (int i = 0; i < numCodeLengths; ++i) lengths[order[i]] = uint8_t(bits(3));
+            huffman codeLengths;
+            codeLengths.build(lengths, 19);
+
+            std::memset(lengths, 0, sizeof(lengths));
+            for (int i = 0; i < numLiterals + numDistances; )
+            {
+                const int symbol = decode(codeLengths);
+                if (symbol < 16) { lengths[i++] = uint8_t(symbol); continue; }
+                int repeat, value = 0;
+                if (symbol == 16)
+                {
+                    if (i == 0) throw std::runtime_error("corrupt png code lengths");
+                    value = lengths[i - 1];
+                    repeat = 3 + bits(2);
+                }
+                else if (symbol == 17) repeat = 3 + bits(3);
+                else repeat = 11 + bits(7);
+                if (i + repeat > numLiterals + numDistances) throw std::runtime_error("corrupt png code lengths");
+                while (repeat--) lengths[i++] = uint8_t(value);
+            }
+            literals.build(lengths, numLiterals);
+            distances.build(lengths + numLiterals, numDistances);
+            state = block::compressed;
+        }
+        else throw std::runtime_error("corrupt png block type");
+    }
+
+    void put(uint8_t * dst, size_t & produced, const uint8_t v)
+    {
+        window[total++ & 32767] = v;
+        dst[produced++] = v;
+    }
+
+public:
+
+    inflate_stream(std::vector<std::pair<const uint8_t *, size_t>> zlibChunks) : chunks(std::move(zlibChunks)), window(32768)
+    {
+        const int cmf = bits(8), flags = bits(8);
+        if ((cmf & 15) != 8 || (cmf * 256 + flags) % 31 != 0 || (flags & 32)) throw std::runtime_error("corrupt png zlib header");
+    }
+
+    // Decodes exactly n bytes into dst, or throws if the stream ends first
+    void read(uint8_t * dst, const size_t n)
+    {
+        static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        size_t produced = 0;
+        while (produced < n)
+        {
+            if (matchRemaining)
+            {
+                // A match can end past this call's output, and may overlap itself (distance < length)
+                for (; matchRemaining && produced < n; --matchRemaining) put(dst, produced, window[(total - matchDistance) & 32767]);
+                continue;
+            }
+
+            switch (state)
+            {
+            case block::header: read_block_header(); break;
+            case block::stored:
+                for (; storedRemaining && produced < n; --storedRemaining) put(dst, produced, uint8_t(bits(8)));
+                if (!storedRemaining) state = block::header;
+                break;
+            case block::compressed:
+            {
+                const int symbol = decode(literals);
+                if (symbol < 256) { put(dst, produced, uint8_t(symbol)); break; }
+                if (symbol == 256) { state = block::header; break; }
+                if (symbol > 285) throw std::runtime_error("corrupt png length code");
+                matchRemaining = lengthBase[symbol - 257] + bits(lengthExtra[symbol - 257]);
+                const int d = decode(distances);
+                if (d > 29) throw std::runtime_error("corrupt png distance code");
+                matchDistance = distanceBase[d] + bits(distanceExtra[d]);
+                if (size_t(matchDistance) > total) throw std::runtime_error("corrupt png distance");
+                break;
+            }
+            case block::done: throw std::runtime_error("truncated png image data");
+            }
+        }
+    }
+};
+
+// Decodes a png one scanline at a time, for pipelining decode with processing and for images whose decoded
+// samples don't fit in memory. Handles non-interlaced 8/16-bit greyscale, grey+alpha, rgb, rgba and 8-bit
+// palette images, and throws for anything else so the caller can fall back to decoding the whole image.
+class png_row_reader
+{
+    png_header head;
+    std::unique_ptr<inflate_stream> inflater;
+    std::vector<uint8_t> rgbPalette;
+    std::vector<uint8_t> line, prior;
+    int stride = 0, bytesPerPixel = 0, row = 0;
+
+public:
+
+    png_row_reader(const uint8_t * binaryData, const size_t size)
+    {
+        if (!png_read_header(binaryData, size, head)) throw std::runtime_error("not a png");
+        if (!supports(head)) throw std::runtime_error("png layout not supported for streaming");
+
+        std::vector<std::pair<const uint8_t *, size_t>> idat;
+        size_t offset = 8;
+        while (offset + 12 <= size)
+        {
+            const uint32_t length = png_read_u32(&binaryData[offset]);
+            const uint8_t * type = &binaryData[offset + 4];
+            if (offset + 12 + length > size) throw std::runtime_error("truncated png");
+            if (std::memcmp(type, "IDAT", 4) == 0) idat.emplace_back(type + 4, length);
+            if (std::memcmp(type, "PLTE", 4) == 0) rgbPalette.assign(type + 4, type + 4 + length);
+            if (std::memcmp(type, "IEND", 4) == 0) break;
+            offset += 12 + length;
+        }
+        if (idat.empty()) throw std::runtime_error("png has no image data");
+        if (head.colorType == 3) rgbPalette.resize(256 * 3, 0); // indices past the palette read as black
+
+        bytesPerPixel = head.channels() * head.bitDepth / 8;
+        stride = head.width * bytesPerPixel;
+        line.resize(stride + 1);
+        prior.resize(stride);
+        inflater.reset(new inflate_stream(std::move(idat)));
+    }
+
+    static bool supports(const png_header & h)
+    {
+        return h.channels() && !h.interlace && (h.colorType == 3 ? h.bitDepth == 8 : (h.bitDepth == 8 || h.bitDepth == 16));
+    }
+
+    const png_header & header() const { return head; }
+    const std::vector<uint8_t> & palette() const { return rgbPalette; }
+
+    // Next unfiltered scanline of stride bytes, valid until the following call. Samples are as stored: 16-bit
+    // samples big-endian and palette images as indices.
+    const uint8_t * next_row()
+    {
+        if (row >= head.height) throw std::runtime_error("read past the last png row");
+        inflater->read(line.data(), line.size());
+        png_unfilter_row(line[0], line.data() + 1, row ? prior.data() : nullptr, stride, bytesPerPixel);
+        std::memcpy(prior.data(), line.data() + 1, stride);
+        ++row;
+        return prior.data();
+    }
+};
+
+// Full-precision samples of a 16-bit greyscale, grey+alpha, rgb or rgba png, big-endian rows swapped to native.
+// Rows come from png_row_reader, so the inflated stream is never held whole and has no 2 GB limit (16K^2 rgba16
+// alone is 2.1 GB).
+inline std::vector<uint16_t> png_decode_16(const uint8_t * binaryData, const size_t size, png_header & header)
+{
+    if (!png_read_header(binaryData, size, header)) throw std::runtime_error("not a png");
+    if (header.bitDepth != 16 || header.channels() == 0 || header.colorType == 3) throw std::runtime_error("png is not 16-bit grey or rgb");
+    if (header.interlace) throw std::runtime_error("interlaced 16-bit png not supported");
+
+    png_row_reader reader(binaryData, size);
+    const size_t rowSamples = size_t(header.width) * header.channels();
+    std::vector<uint16_t> samples(rowSamples * header.height);
+    for (int y = 0; y < header.height; ++y)
+    {
+        const uint8_t * row = reader.next_row();
+        uint16_t * dst = &samples[size_t(y) * rowSamples];
+        for (size_t i = 0; i < rowSamples; ++i) dst[i] = uint16_t((row[2 * i] << 8) | row[2 * i + 1]);
+    }
+    return samples;
+}
+
+#endif // end png_decode_hpp
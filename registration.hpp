@@ -0,0 +1,128 @@
+#ifndef registration_hpp
+#define registration_hpp
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <limits>
+#include "image.hpp"
+#include "fft.hpp"
+#include "spectrum.hpp"
+#include "thread_pool.hpp"
+
+///////////////////////////
+//   Phase Correlation   //
+///////////////////////////
+
+struct registration_result
+{
+    float2 shift = { 0, 0 }; // moved(x) ~ reference(x - shift), in pixels, wrapped to (-size/2, size/2]
+    float peak = 0;          // height of the correlation peak: ~1 for a pure translation, near 0 for unrelated images
+};
+
+// Translation between two images of the same size by phase correlation. Both images are real, so they are
+// packed into one complex transform (reference in the real part, moved in the imaginary part) and separated
+// using the conjugate symmetry of real spectra: one forward and one inverse transform per pair.
+// The buffers are kept between calls and only reallocated when the image size changes, and the transforms use
+// per-thread scratch, so one correlator per worker reuses its memory across pairs. Serial correlators of images up to
+// 64K pixels allocate nothing per pair; larger ones allocate the mean's small chunk table, and parallel ones the
+// pool's job state.
+class phase_correlator
+{
+    int2 size = { 0, 0 };
+    window_type window;
+    bool parallel;
+    std::vector<std::complex<float>> packed;
+    std::vector<std::complex<float>> cross;
+
+    void resize(const int2 newSize)
+    {
+        if (newSize == size) return;
+        size = newSize;
+        packed.resize(size_t(size.x) * size.y);
+        cross.resize(size_t(size.x) * size.y);
+    }
+
+    // Value of the correlation surface with wraparound
+    float at(const int y, const int x) const
+    {
+        return cross[size_t((y + size.y) % size.y) * size.x + (x + size.x) % size.x].real();
+    }
+
+    // Sub-pixel offset of a peak from its two neighbours along one axis (Foroosh et al.): for a pure translation
+    // the surface is a sampled Dirichlet kernel, and the ratio of the larger neighbour to the peak gives the offset.
+    static float subpixel_offset(const float left, const float centre, const float right)
+    {
+        if (centre <= 0) return 0;
+        const float side = right > left ? 1.f : -1.f;
+        const float neighbour = std::max(left, right);
+        if (neighbour <= 0) return 0;
+        return side * neighbour / (neighbour + centre);
+    }
+
+public:
+
+    // Windowing keeps the jump between opposite borders from correlating with itself at zero shift.
+    // Pass parallel = false when pairs are already spread across the pool.
+    phase_correlator(const window_type window = window_type::hann, const bool parallel = true) : window(window), parallel(parallel) {}
+
+    registration_result correlate(image_buffer<float, 1> & reference, image_buffer<float, 1> & moved)
+    {
+        if (reference.size != moved.size) throw std::runtime_error("registered images must have the same dimensions");
+        resize(reference.size);
+
+        const int width = size.x, height = size.y;
+        const float meanReference = reference.compute_mean(), meanMoved = moved.compute_mean();
+        auto wx = get_fft_plan_cache().get_window(window, width);
+        auto wy = get_fft_plan_cache().get_window(window, height);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const float * a = &reference(y, 0);
+            const float * b = &moved(y, 0);
+            for (int x = 0; x < width; ++x)
+            {
+                const float w = (*wx)[x] * (*wy)[y];
+                packed[size_t(y) * width + x] = { (a[x] - meanReference) * w, (b[x] - meanMoved) * w };
+            }
+        }
+
+        compute_fft_2d(packed.data(), size, false, parallel);
+
+        // With z = a + ib and both real: A(k) = (Z(k) + conj Z(-k)) / 2, B(k) = (Z(k) - conj Z(-k)) / 2i.
+        // The normalized cross-power spectrum B conj(A) / |B conj(A)| keeps only the phase difference.
+        for (int y = 0; y < height; ++y)
+        {
+            const size_t row = size_t(y) * width, mirrorRow = size_t((height - y) % height) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                const std::complex<float> z = packed[row + x], zm = std::conj(packed[mirrorRow + (width - x) % width]);
+                const std::complex<float> a = 0.5f * (z + zm);
+                const std::complex<float> b = std::complex<float>(0, -0.5f) * (z - zm);
+                const std::complex<float> r = b * std::conj(a);
+                const float magnitude = std::abs(r);
+                cross[row + x] = magnitude > 1e-20f ? r / magnitude : 0.f;
+            }
+        }
+        cross[0] = 0; // both means are removed
+
+        compute_fft_2d(cross.data(), size, true, parallel);
+
+        int peakX = 0, peakY = 0;
+        float peak = -std::numeric_limits<float>::max();
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                const float v = cross[size_t(y) * width + x].real();
+                if (v > peak) { peak = v; peakX = x; peakY = y; }
+            }
+
+        registration_result result;
+        result.shift.x = signed_frequency(peakX, width) + subpixel_offset(at(peakY, peakX - 1), peak, at(peakY, peakX + 1));
+        result.shift.y = signed_frequency(peakY, height) + subpixel_offset(at(peakY - 1, peakX), peak, at(peakY + 1, peakX));
+        result.peak = peak / (float(width) * height);
+        return result;
+    }
+};
+
+#endif // end registration_hpp
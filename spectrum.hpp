@@ -0,0 +1,910 @@
+#ifndef spectrum_hpp
+#define spectrum_hpp
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <cmath>
+#include <mutex>
+#include "image.hpp"
+#include "fft.hpp"
+#include "thread_pool.hpp"
+
+///////////////////////////
+//   Spectrum Utilities  //
+///////////////////////////
+
+// Signed frequency index of bin i in a transform of length n (0, 1, ..., n/2, -n/2 + 1, ..., -1)
+inline int signed_frequency(const int i, const int n)
+{
+    return i <= n / 2 ? i : i - n;
+}
+
+// Polynomial atan2 (max error ~1e-5 rad). Branch-free, unlike std::atan2, so loops calling it still vectorize.
+inline float fast_atan2(const float y, const float x)
+{
+    const float ax = std::abs(x), ay = std::abs(y);
+    const float z = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+    const float z2 = z * z;
+    float a = z * (0.99997726f + z2 * (-0.33262347f + z2 * (0.19354346f + z2 * (-0.11643287f + z2 * (0.05265332f + z2 * -0.01172120f)))));
+    a = ay > ax ? 1.57079633f - a : a;
+    a = x < 0 ? 3.14159265f - a : a;
+    return y < 0 ? -a : a;
+}
+
+inline float to_decibels(const double ratio)
+{
+    return float(10.0 * std::log10(std::max(ratio, 1e-30)));
+}
+
+///////////////////////////////////
+//   Compression Spectral Diff   //
+///////////////////////////////////
+
+struct spectral_compare_result
+{
+    std::shared_ptr<image_buffer<float, 1>> diffImage;  // centered, 0.5 = no change, brighter = energy added by compression
+    float blockHarmonicDb = 0;                          // energy on the 4-pixel block harmonics, compressed vs source
+    float blockHarmonicFraction = 0;                    // share of compressed energy sitting on those harmonics
+    float totalEnergyDb = 0;
+    std::vector<float> octaveLossDb;                    // [0] is the highest octave (0.25 - 0.5 cycles/px), negative = loss
+};
+
+// Compares the spectra of a master image and its block-compressed version. Both spectra are mean-subtracted,
+// unwindowed transforms of the same size. diffRangeDb is the log-spectrum difference that maps to black/white.
+inline spectral_compare_result compare_spectra(image_buffer<float, 1> & source, image_buffer<float, 1> & compressed, const float diffRangeDb = 40.f)
+{
+    if (source.size != compressed.size) throw std::runtime_error("compared images must have the same dimensions");
+
+    const int width = source.size.x;
+    const int height = source.size.y;
+    const int blockSize = 4;
+    const int numOctaves = std::max(1, std::min(6, (int)std::log2((float)std::min(width, height)) - 1));
+
+    std::vector<std::complex<float>> sourceSpectrum = compute_spectrum(source);
+    std::vector<std::complex<float>> compressedSpectrum = compute_spectrum(compressed);
+
+    struct partial_sums
+    {
+        double sourceTotal = 0, compressedTotal = 0;
+        double sourceBlock = 0, compressedBlock = 0;
+        std::vector<double> sourceOctave, compressedOctave;
+    };
+
+    const int grain = 16;
+    std::vector<partial_sums> partials((height + grain - 1) / grain);
+    for (auto & p : partials)
+    {
+        p.sourceOctave.assign(numOctaves, 0.0);
+        p.compressedOctave.assign(numOctaves, 0.0);
+    }
+
+    image_buffer<float, 1> diff(source.size);
+    const float dbToDisplay = 0.5f / diffRangeDb;
+
+    parallel_for(0, height, grain, [&](int y0, int y1)
+    {
+        partial_sums & p = partials[y0 / grain];
+
+        for (int y = y0; y < y1; ++y)
+        {
+            const int fv = signed_frequency(y, height);
+            const bool blockRow = fv != 0 && (y * blockSize) % height == 0;
+            const float rv = float(fv) / height;
+
+            for (int x = 0; x < width; ++x)
+            {
+                const int i = y * width + x;
+                const double ps = std::norm(sourceSpectrum[i]);
+                const double pc = std::norm(compressedSpectrum[i]);
+
+                diff(y, x) = clamp(0.5f + to_decibels((pc + 1e-12) / (ps + 1e-12)) * dbToDisplay, 0.f, 1.f);
+
+                const int fu = signed_frequency(x, width);
+                if (fu == 0 && fv == 0) continue;
+
+                p.sourceTotal += ps;
+                p.compressedTotal += pc;
+
+                if (blockRow || (fu != 0 && (x * blockSize) % width == 0))
+                {
+                    p.sourceBlock += ps;
+                    p.compressedBlock += pc;
+                }
+
+                // Octave k covers radii (0.5 / 2^(k+1), 0.5 / 2^k]; the corners past 0.5 belong to the top octave
+                const float ru = float(fu) / width;
+                const float radius = std::sqrt(ru * ru + rv * rv);
+                const int octave = radius >= 0.5f ? 0 : (int)std::floor(-std::log2(radius * 2.f));
+                if (octave < numOctaves)
+                {
+                    p.sourceOctave[octave] += ps;
+                    p.compressedOctave[octave] += pc;
+                }
+            }
+        }
+    });
+
+    partial_sums total;
+    total.sourceOctave.assign(numOctaves, 0.0);
+    total.compressedOctave.assign(numOctaves, 0.0);
+    for (auto & p : partials)
+    {
+        total.sourceTotal += p.sourceTotal;
+        total.compressedTotal += p.compressedTotal;
+        total.sourceBlock += p.sourceBlock;
+        total.compressedBlock += p.compressedBlock;
+        for (int k = 0; k < numOctaves; ++k)
+        {
+            total.sourceOctave[k] += p.sourceOctave[k];
+            total.compressedOctave[k] += p.compressedOctave[k];
+        }
+    }
+
+    spectral_compare_result result;
+    result.diffImage = std::make_shared<image_buffer<float, 1>>(source.size);
+    center_fft_image(diff, *result.diffImage);
+
+    const double tiny = 1e-12;
+    result.totalEnergyDb = to_decibels((total.compressedTotal + tiny) / (total.sourceTotal + tiny));
+    result.blockHarmonicDb = to_decibels((total.compressedBlock + tiny) / (total.sourceBlock + tiny));
+    result.blockHarmonicFraction = float(total.compressedBlock / std::max(total.compressedTotal, tiny));
+    for (int k = 0; k < numOctaves; ++k)
+    {
+        result.octaveLossDb.push_back(to_decibels((total.compressedOctave[k] + tiny) / (total.sourceOctave[k] + tiny)));
+    }
+    return result;
+}
+
+/////////////////////////////
+//   Spectrum Statistics   //
+/////////////////////////////
+
+struct spectrum_statistics
+{
+    std::vector<float> radialPower;     // mean power per annulus; bin i covers radii [i, i + 1) * 0.5 / bins cycles/px
+    std::vector<uint64_t> radialCount;  // frequencies that fell into each annulus
+    std::vector<float> angularPower;    // share of in-band power per frequency direction; bin i covers [i, i + 1) * 180 / bins degrees
+    double totalPower = 0;              // excluding DC
+    float spectralCentroid = 0;         // power-weighted mean radius, cycles/px
+    float highFrequencyFraction = 0;    // share of power above 0.25 cycles/px
+    float anisotropy = 0;               // 0 = isotropic, 1 = all energy along a single direction
+    float dominantOrientation = 0;      // degrees in [0, 180) of the image features (perpendicular to their frequencies), y down
+};
+
+inline float radial_bin_frequency(const spectrum_statistics & stats, const size_t bin)
+{
+    return (bin + 0.5f) * 0.5f / stats.radialPower.size();
+}
+
+// Single sweep over an uncentered 2D spectrum (as produced by compute_fft_2d) that gathers every statistic at once.
+// Indexing by signed frequency is equivalent to working on the centered image, without needing the shifted copy.
+// Rows can be added in any number of bands, so spectra that never sit in memory whole (out of core) get the same
+// statistics. Every chunk of rows accumulates into its own histograms, merged at the end of each band. Radial and
+// angular histograms only cover the disc inside Nyquist; the corners still count towards the totals.
+// Orientation comes from the power-weighted doubled-angle mean (cos 2t, sin 2t), which treats t and t + 180 alike.
+class spectrum_statistics_accumulator
+{
+    struct partial_histogram
+    {
+        std::vector<double> power, angular;
+        std::vector<uint64_t> count;
+        double total = 0, weightedRadius = 0, high = 0, cos2 = 0, sin2 = 0;
+
+        void reset(const int numBins, const int numAngleBins)
+        {
+            power.assign(numBins + 1, 0.0); // last bin collects everything past Nyquist and is dropped
+            count.assign(numBins + 1, 0);
+            angular.assign(numAngleBins, 0.0);
+            total = weightedRadius = high = cos2 = sin2 = 0;
+        }
+    };
+
+    int2 size;
+    int numBins, numAngleBins;
+    std::vector<float> ru, ru2; // horizontal frequencies are shared by every row
+    partial_histogram sum;
+    double dc = 0;
+
+public:
+
+    spectrum_statistics_accumulator(const int2 & size, const int numAngleBins = 36) : size(size), numBins(std::max(1, std::min(size.x, size.y) / 2)), numAngleBins(numAngleBins), ru(size.x), ru2(size.x)
+    {
+        for (int x = 0; x < size.x; ++x) { ru[x] = float(signed_frequency(x, size.x)) / size.x; ru2[x] = ru[x] * ru[x]; }
+        sum.reset(numBins, numAngleBins);
+    }
+
+    // rows holds rowCount full rows of the spectrum starting at firstRow
+    void add_rows(const std::complex<float> * rows, const int firstRow, const int rowCount)
+    {
+        const int width = size.x, height = size.y;
+        const float binScale = 2.f * numBins;
+        const float pi = 3.14159265358979f;
+        const float angleScale = numAngleBins / pi;
+
+        const int grain = 64;
+        std::vector<partial_histogram> partials((rowCount + grain - 1) / grain);
+        for (auto & h : partials) h.reset(numBins, numAngleBins);
+
+        parallel_for(0, rowCount, grain, [&](int r0, int r1)
+        {
+            partial_histogram & h = partials[r0 / grain];
+
+            std::vector<int> bins(width), angleBins(width);
+            std::vector<float> power(width), inBand(width), weighted(width), high(width), cos2(width), sin2(width);
+
+            for (int r = r0; r < r1; ++r)
+            {
+                const float rv = float(signed_frequency(firstRow + r, height)) / height;
+                const float rv2 = rv * rv;
+                const std::complex<float> * row = rows + size_t(r) * width;
+
+                // Branch-free and independent per element, so the compiler vectorizes the sqrt / convert
+                for (int x = 0; x < width; ++x)
+                {
+                    const float r2 = ru2[x] + rv2;
+                    const float invR2 = 1.f / std::max(r2, 1e-20f);
+                    // Orientations are folded into [0, pi): negative u on the horizontal axis gives exactly pi
+                    float angle = fast_atan2(rv, ru[x]);
+                    angle += angle < 0 ? pi : 0.f;
+                    angle -= angle >= pi ? pi : 0.f;
+
+                    const float radius = std::sqrt(r2);
+                    const float p = row[x].real() * row[x].real() + row[x].imag() * row[x].imag();
+
+                    bins[x] = std::min(int(radius * binScale), numBins);
+                    angleBins[x] = std::min(int(angle * angleScale), numAngleBins - 1);
+                    power[x] = p;
+                    inBand[x] = radius < 0.5f ? p : 0.f;
+                    weighted[x] = p * radius;
+                    high[x] = radius > 0.25f ? p : 0.f;
+                    cos2[x] = inBand[x] * (ru2[x] - rv2) * invR2;
+                    sin2[x] = inBand[x] * 2.f * ru[x] * rv * invR2;
+                }
+
+                double total = 0, weightedRadius = 0, highPower = 0, c2 = 0, s2 = 0;
+                for (int x = 0; x < width; ++x)
+                {
+                    h.power[bins[x]] += power[x];
+                    h.count[bins[x]]++;
+                    h.angular[angleBins[x]] += inBand[x];
+                    total += power[x];
+                    weightedRadius += weighted[x];
+                    highPower += high[x];
+                    c2 += cos2[x];
+                    s2 += sin2[x];
+                }
+                h.total += total;
+                h.weightedRadius += weightedRadius;
+                h.high += highPower;
+                h.cos2 += c2;
+                h.sin2 += s2;
+            }
+        });
+
+        for (auto & h : partials)
+        {
+            for (int i = 0; i <= numBins; ++i) { sum.power[i] += h.power[i]; sum.count[i] += h.count[i]; }
+            for (int i = 0; i < numAngleBins; ++i) sum.angular[i] += h.angular[i];
+            sum.total += h.total;
+            sum.weightedRadius += h.weightedRadius;
+            sum.high += h.high;
+            sum.cos2 += h.cos2;
+            sum.sin2 += h.sin2;
+        }
+
+        if (firstRow == 0 && rowCount > 0) dc = std::norm(rows[0]);
+    }
+
+    spectrum_statistics finish() const
+    {
+        spectrum_statistics stats;
+        stats.radialPower.assign(numBins, 0.f);
+        stats.radialCount.assign(sum.count.begin(), sum.count.begin() + numBins);
+        stats.angularPower.assign(numAngleBins, 0.f);
+
+        // DC was binned with everything else to keep the inner loop branch-free; it sits at radius 0, angle 0
+        partial_histogram total = sum;
+        total.total -= dc;
+        total.power[0] -= dc;
+        total.angular[0] -= dc;
+        stats.radialCount[0]--;
+
+        const double tiny = 1e-30;
+        const float pi = 3.14159265358979f;
+        double inBand = 0;
+        for (int i = 0; i < numAngleBins; ++i) inBand += total.angular[i];
+
+        for (int i = 0; i < numBins; ++i) stats.radialPower[i] = stats.radialCount[i] ? float(total.power[i] / stats.radialCount[i]) : 0.f;
+        for (int i = 0; i < numAngleBins; ++i) stats.angularPower[i] = float(total.angular[i] / std::max(inBand, tiny));
+
+        stats.totalPower = total.total;
+        stats.spectralCentroid = float(total.weightedRadius / std::max(total.total, tiny));
+        stats.highFrequencyFraction = float(total.high / std::max(total.total, tiny));
+        stats.anisotropy = float(std::sqrt(total.cos2 * total.cos2 + total.sin2 * total.sin2) / std::max(inBand, tiny));
+
+        // Features run perpendicular to the dominant frequency direction
+        float orientation = float(0.5 * std::atan2(total.sin2, total.cos2)) * 180.f / pi + 90.f;
+        stats.dominantOrientation = std::fmod(orientation + 180.f, 180.f);
+        return stats;
+    }
+};
+
+inline spectrum_statistics compute_spectrum_statistics(const std::complex<float> * spectrum, const int2 & size, const int numAngleBins = 36)
+{
+    spectrum_statistics_accumulator accumulator(size, numAngleBins);
+    accumulator.add_rows(spectrum, 0, size.y);
+    return accumulator.finish();
+}
+
+/////////////////////////////////////////
+//   Periodic + Smooth Decomposition   //
+/////////////////////////////////////////
+
+// Moisan, "Periodic plus smooth image decomposition" (2011). The image u = p + s, where p is periodic and s is a
+// smooth image carrying the jumps across opposite borders, which is what puts a bright cross on the axes of the
+// spectrum of a non-tileable texture. s solves a Poisson equation driven only by those jumps, so its spectrum is the
+// FFT of a border image divided by the eigenvalues of the discrete Laplacian, and the spectrum of p follows as
+// fft(u) - fft(s) without ever going back to the spatial domain.
+struct periodic_spectrum
+{
+    std::vector<std::complex<float>> spectrum;  // uncentered spectrum of the periodic component, mean removed
+    float seamEnergy = 0;                       // share of the mean-removed image energy in the smooth component
+};
+
+inline periodic_spectrum compute_periodic_spectrum(image_buffer<float, 1> & img)
+{
+    const int width = img.size.x, height = img.size.y;
+    const float pi = 3.14159265358979f;
+
+    periodic_spectrum result;
+    result.spectrum = compute_spectrum(img);
+
+    // Border image: the jump between opposite edges, with opposite signs on each side
+    std::vector<std::complex<float>> border(img.num_pixels(), 0.f);
+    for (int x = 0; x < width; ++x)
+    {
+        const float jump = img(height - 1, x) - img(0, x);
+        border[x] += jump;
+        border[size_t(height - 1) * width + x] -= jump;
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        const float jump = img(y, width - 1) - img(y, 0);
+        border[size_t(y) * width] += jump;
+        border[size_t(y) * width + width - 1] -= jump;
+    }
+    compute_fft_2d(border.data(), img.size);
+
+    std::vector<float> cosX(width), cosY(height);
+    for (int x = 0; x < width; ++x) cosX[x] = 2.f * std::cos(2.f * pi * x / width);
+    for (int y = 0; y < height; ++y) cosY[y] = 2.f * std::cos(2.f * pi * y / height);
+
+    const int grain = 64;
+    std::vector<double> smoothPartials((height + grain - 1) / grain, 0.0), totalPartials(smoothPartials.size(), 0.0);
+
+    parallel_for(0, height, grain, [&](int y0, int y1)
+    {
+        double smoothEnergy = 0, totalEnergy = 0;
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const size_t i = size_t(y) * width + x;
+                const float eigenvalue = cosX[x] + cosY[y] - 4.f;
+                const std::complex<float> smooth = (x == 0 && y == 0) ? 0.f : border[i] / eigenvalue;
+                totalEnergy += std::norm(result.spectrum[i]);
+                smoothEnergy += std::norm(smooth);
+                result.spectrum[i] -= smooth;
+            }
+        }
+        smoothPartials[y0 / grain] = smoothEnergy;
+        totalPartials[y0 / grain] = totalEnergy;
+    });
+
+    double smoothEnergy = 0, totalEnergy = 0;
+    for (size_t i = 0; i < smoothPartials.size(); ++i) { smoothEnergy += smoothPartials[i]; totalEnergy += totalPartials[i]; }
+    result.seamEnergy = float(smoothEnergy / std::max(totalEnergy, 1e-30));
+    return result;
+}
+
+//////////////////////////
+//   Welch Periodogram  //
+//////////////////////////
+
+// Total weight of a square tile window w[x] * w[y], the same for every tile
+inline double tile_window_weight(const std::vector<float> & w)
+{
+    double sum = 0;
+    for (float v : w) sum += v;
+    return sum * sum;
+}
+
+// Square tile of the image, windowed along both axes after subtracting its window-weighted mean, so that no DC leaks
+// through the window into the lowest bins. windowWeight comes from tile_window_weight(w).
+inline void load_windowed_tile(const image_view<const float, 1> & tile, const std::vector<float> & w, const double windowWeight, std::complex<float> * dst)
+{
+    const float mean = float(windowed_mean(tile, w.data(), w.data(), windowWeight));
+
+    for (int y = 0; y < tile.size.y; ++y, dst += tile.size.x)
+    {
+        const float * src = tile.row_data(y);
+        for (int x = 0; x < tile.size.x; ++x) dst[x] = (src[x] - mean) * w[x] * w[y];
+    }
+}
+
+// Averages the power spectra of overlapping windowed tiles (Welch's method). The result has lower variance than a
+// single full-size transform, and memory stays bounded: each job holds one tile and one accumulator, merged under a
+// lock when the job ends, so a 16K texture never needs its 2 GB full-resolution spectrum.
+// The returned spectrum is tileSize^2 and uncentered, with magnitudes set to the square root of the averaged power
+// (phase is meaningless) so it feeds the same statistics and display paths as a regular spectrum.
+inline std::vector<std::complex<float>> compute_welch_spectrum(image_buffer<float, 1> & img, const int tileSize = 256, const window_type window = window_type::hann)
+{
+    const int width = img.size.x, height = img.size.y;
+    if (width < tileSize || height < tileSize) throw std::runtime_error("image is smaller than a welch tile");
+
+    const int step = tileSize / 2;
+    const int tilesX = (width - tileSize) / step + 1, tilesY = (height - tileSize) / step + 1;
+    const size_t tilePixels = size_t(tileSize) * tileSize;
+
+    auto wt = get_fft_plan_cache().get_window(window, tileSize);
+    const std::vector<float> & w = *wt;
+    const double windowWeight = tile_window_weight(w);
+
+    std::vector<double> sum(tilePixels, 0.0);
+    std::mutex sumMutex;
+
+    // One job per row of tiles
+    parallel_for(0, tilesY, 1, [&](int ty0, int ty1)
+    {
+        std::vector<std::complex<float>> tile(tilePixels);
+        std::vector<double> accumulator(tilePixels, 0.0);
+
+        for (int ty = ty0; ty < ty1; ++ty)
+        {
+            for (int tx = 0; tx < tilesX; ++tx)
+            {
+                const image_view<const float, 1> source = img.view().subview({ tx * step, ty * step }, { tileSize, tileSize });
+
+                load_windowed_tile(source, w, windowWeight, tile.data());
+
+                compute_fft_2d(tile.data(), { tileSize, tileSize }, false, false);
+                for (size_t i = 0; i < tilePixels; ++i) accumulator[i] += std::norm(tile[i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(sumMutex);
+        for (size_t i = 0; i < tilePixels; ++i) sum[i] += accumulator[i];
+    });
+
+    const double scale = 1.0 / (double(tilesX) * tilesY);
+    std::vector<std::complex<float>> spectrum(tilePixels);
+    for (size_t i = 0; i < tilePixels; ++i) spectrum[i] = float(std::sqrt(sum[i] * scale));
+    return spectrum;
+}
+
+///////////////////////////
+//   Local Spectrum Map  //
+///////////////////////////
+
+struct local_spectrum_map
+{
+    int tileSize = 0;
+    int step = 0;
+    std::shared_ptr<image_buffer<float, 1>> dominantFrequency;      // per tile, radius of the strongest non-DC bin in cycles/px
+    std::shared_ptr<image_buffer<float, 1>> highFrequencyFraction;  // per tile, share of power above 0.25 cycles/px
+};
+
+// Short-time 2D Fourier transform over a grid of windowed tiles, for atlases and trim sheets whose regions have
+// very different frequency content. Tiles are transformed one row of tiles per job, all through the same cached
+// plan and window, and reduced to two numbers each straight away, so no tile spectrum outlives its job.
+inline local_spectrum_map compute_local_spectrum_map(image_buffer<float, 1> & img, const int tileSize = 64, const int step = 64, const window_type window = window_type::hann)
+{
+    const int width = img.size.x, height = img.size.y;
+    if (width < tileSize || height < tileSize) throw std::runtime_error("image is smaller than a local spectrum tile");
+
+    const int2 grid = { (width - tileSize) / step + 1, (height - tileSize) / step + 1 };
+    const size_t tilePixels = size_t(tileSize) * tileSize;
+
+    local_spectrum_map map;
+    map.tileSize = tileSize;
+    map.step = step;
+    map.dominantFrequency = std::make_shared<image_buffer<float, 1>>(grid);
+    map.highFrequencyFraction = std::make_shared<image_buffer<float, 1>>(grid);
+
+    auto wt = get_fft_plan_cache().get_window(window, tileSize);
+    const std::vector<float> & w = *wt;
+    const double windowWeight = tile_window_weight(w);
+
+    // Radius of every bin of a tile spectrum, shared by all tiles
+    std::vector<float> radius(tilePixels);
+    for (int y = 0; y < tileSize; ++y)
+        for (int x = 0; x < tileSize; ++x)
+        {
+            const float ru = float(signed_frequency(x, tileSize)) / tileSize, rv = float(signed_frequency(y, tileSize)) / tileSize;
+            radius[size_t(y) * tileSize + x] = std::sqrt(ru * ru + rv * rv);
+        }
+
+    parallel_for(0, grid.y, 1, [&](int ty0, int ty1)
+    {
+        std::vector<std::complex<float>> tile(tilePixels);
+
+        for (int ty = ty0; ty < ty1; ++ty)
+        {
+            for (int tx = 0; tx < grid.x; ++tx)
+            {
+                const image_view<const float, 1> source = img.view().subview({ tx * step, ty * step }, { tileSize, tileSize });
+
+                load_windowed_tile(source, w, windowWeight, tile.data());
+
+                compute_fft_2d(tile.data(), { tileSize, tileSize }, false, false);
+
+                double total = 0, high = 0;
+                float peak = 0, peakRadius = 0;
+                for (size_t i = 1; i < tilePixels; ++i)
+                {
+                    const float p = std::norm(tile[i]);
+                    total += p;
+                    high += radius[i] > 0.25f ? p : 0.f;
+                    if (p > peak) { peak = p; peakRadius = radius[i]; }
+                }
+
+                (*map.dominantFrequency)(ty, tx) = peakRadius;
+                (*map.highFrequencyFraction)(ty, tx) = float(high / std::max(total, 1e-30));
+            }
+        }
+    });
+
+    return map;
+}
+
+////////////////////////////
+//   Incremental Update   //
+////////////////////////////
+
+struct image_region
+{
+    int2 min = { 0, 0 };
+    int2 max = { 0, 0 }; // exclusive
+    int2 size() const { return max - min; }
+    bool empty() const { return max.x <= min.x || max.y <= min.y; }
+};
+
+// Bounding box of the pixels that differ between two images of the same size
+inline image_region find_changed_region(image_buffer<float, 1> & a, image_buffer<float, 1> & b)
+{
+    const int width = a.size.x, height = a.size.y;
+    std::vector<int> rowMin(height, width), rowMax(height, 0);
+
+    parallel_for(0, height, 64, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            const float * pa = &a(y, 0);
+            const float * pb = &b(y, 0);
+            int first = 0;
+            while (first < width && pa[first] == pb[first]) ++first;
+            if (first == width) continue;
+            int last = width - 1;
+            while (pa[last] == pb[last]) --last;
+            rowMin[y] = first;
+            rowMax[y] = last + 1;
+        }
+    });
+
+    image_region region;
+    region.min = { width, height };
+    for (int y = 0; y < height; ++y)
+    {
+        if (rowMax[y] <= rowMin[y]) continue;
+        region.min = { std::min(region.min.x, rowMin[y]), std::min(region.min.y, y) };
+        region.max = { std::max(region.max.x, rowMax[y]), y + 1 };
+    }
+    return region;
+}
+
+// Smallest divisor of n that is at least count
+inline int smallest_divisor_at_least(const int n, const int count)
+{
+    for (int p = std::max(1, count); p < n; ++p) if (n % p == 0) return p;
+    return n;
+}
+
+// All n bins of the DFT of a signal that is zero outside [offset, offset + count): out[k] = sum in[a] w^(k (offset + a)),
+// with twiddles[t] = w^t = exp(-2 pi i t / n). Bins k = j + (n / p) m of each residue j are the p-point transform of the
+// input modulated by w^(a j), so the cost is n log p for the smallest divisor p of n that holds the input, instead of
+// n log n. A handful of samples is cheaper to sum directly.
+inline void sparse_dft(const std::complex<float> * in, const int count, const int offset, const int n, const std::vector<std::complex<float>> & twiddles,
+    std::complex<float> * out, std::vector<std::complex<float>> & scratch)
+{
+    // Twiddle indices are stepped modulo n rather than multiplied and divided
+    auto advance = [n](const int t, const int step) { return t + step < n ? t + step : t + step - n; };
+
+    if (count <= 4)
+    {
+        std::fill(out, out + n, std::complex<float>(0));
+        for (int a = 0; a < count; ++a)
+        {
+            const int step = (offset + a) % n;
+            for (int k = 0, t = 0; k < n; ++k, t = advance(t, step)) out[k] += in[a] * twiddles[t];
+        }
+        return;
+    }
+
+    const int p = smallest_divisor_at_least(n, count), residues = n / p;
+    auto plan = get_fft_plan_cache().get(p, false);
+    scratch.resize(2 * size_t(p));
+    std::complex<float> * modulated = scratch.data();
+    std::complex<float> * transformed = scratch.data() + p;
+
+    const int phaseStep = int(size_t(residues) * offset % n);
+
+    for (int j = 0; j < residues; ++j)
+    {
+        for (int a = 0, t = 0; a < count; ++a, t = advance(t, j)) modulated[a] = in[a] * twiddles[t];
+        std::fill(modulated + count, modulated + p, std::complex<float>(0));
+        plan->transform(modulated, transformed);
+        for (int m = 0, t = int(size_t(j) * offset % n); m < p; ++m, t = advance(t, phaseStep)) out[j + residues * m] = transformed[m] * twiddles[t];
+    }
+}
+
+// Brings the mean-subtracted, unwindowed spectrum of oldImg (as from compute_spectrum) up to date with newImg by adding
+// the transform of their difference, which is zero outside the bounding box of the edit. Only the changed rows are
+// transformed along x, and each column along y only from those rows (n log h instead of n log n). Every bin changes
+// for any edit, so the column pass still touches the whole spectrum: a 64x64 patch on a 4096^2 texture costs about a
+// third of a full transform. Edits large enough that this isn't cheaper recompute the spectrum instead.
+// Returns the changed region, empty if the images are identical.
+inline image_region update_spectrum(std::vector<std::complex<float>> & spectrum, image_buffer<float, 1> & oldImg, image_buffer<float, 1> & newImg)
+{
+    if (oldImg.size != newImg.size || spectrum.size() != size_t(newImg.num_pixels())) throw std::runtime_error("cached spectrum doesn't match the image");
+
+    const image_region region = find_changed_region(oldImg, newImg);
+    if (region.empty()) return region;
+
+    const int width = newImg.size.x, height = newImg.size.y;
+    const int2 changed = region.size();
+
+    const double pixels = double(width) * height;
+    const double incrementalCost = double(changed.y) * width * std::log2(smallest_divisor_at_least(width, changed.x)) + pixels * (std::log2(smallest_divisor_at_least(height, changed.y)) + 2);
+    if (incrementalCost >= pixels * (std::log2(width) + std::log2(height)))
+    {
+        spectrum = compute_spectrum(newImg);
+        return region;
+    }
+
+    const auto twiddlesX = get_fft_plan_cache().get_twiddles(width), twiddlesY = get_fft_plan_cache().get_twiddles(height);
+    std::vector<std::complex<float>> rows(size_t(changed.y) * width);
+
+    const image_view<const float, 1> before = oldImg.view().subview(region.min, changed), after = newImg.view().subview(region.min, changed);
+    parallel_for(0, changed.y, 16, [&](int r0, int r1)
+    {
+        std::vector<std::complex<float>> delta(changed.x), scratch;
+        for (int r = r0; r < r1; ++r)
+        {
+            const float * a = before.row_data(r), * b = after.row_data(r);
+            for (int x = 0; x < changed.x; ++x) delta[x] = b[x] - a[x];
+            sparse_dft(delta.data(), changed.x, region.min.x, width, *twiddlesX, &rows[size_t(r) * width], scratch);
+        }
+    });
+
+    // Columns in blocks of adjacent x, so that adding into the spectrum writes whole cache lines per row
+    const int blockWidth = 16;
+    parallel_for(0, (width + blockWidth - 1) / blockWidth, 1, [&](int b0, int b1)
+    {
+        std::vector<std::complex<float>> column(changed.y), result(size_t(blockWidth) * height), scratch;
+        for (int block = b0; block < b1; ++block)
+        {
+            const int x0 = block * blockWidth, bw = std::min(blockWidth, width - x0);
+            for (int b = 0; b < bw; ++b)
+            {
+                for (int r = 0; r < changed.y; ++r) column[r] = rows[size_t(r) * width + x0 + b];
+                sparse_dft(column.data(), changed.y, region.min.y, height, *twiddlesY, &result[size_t(b) * height], scratch);
+            }
+            for (int y = 0; y < height; ++y)
+            {
+                std::complex<float> * dst = &spectrum[size_t(y) * width + x0];
+                for (int b = 0; b < bw; ++b) dst[b] += result[size_t(b) * height + y];
+            }
+        }
+    });
+
+    spectrum[0] = 0; // the change of the mean goes with the mean
+    return region;
+}
+
+//////////////////////////////////
+//   Texture Array / Cubemaps   //
+//////////////////////////////////
+
+// Box-filters by an integer factor in both directions
+inline image_buffer<float, 1> downsample_box(const image_view<const float, 1> & in, const int factor)
+{
+    image_buffer<float, 1> out({ std::max(1, in.size.x / factor), std::max(1, in.size.y / factor) });
+    const float norm = 1.f / (factor * factor);
+    for (int y = 0; y < out.size.y; ++y)
+    {
+        for (int x = 0; x < out.size.x; ++x)
+        {
+            float sum = 0;
+            for (int j = 0; j < factor; ++j)
+                for (int i = 0; i < factor; ++i)
+                    sum += in(y * factor + j, x * factor + i);
+            out(y, x) = sum * norm;
+        }
+    }
+    return out;
+}
+
+struct layer_spectrum
+{
+    int layer = 0;
+    int face = 0;
+    float mean = 0;
+    float spectralCentroid = 0;         // power-weighted mean radius, cycles/px
+    float highFrequencyFraction = 0;    // share of power above 0.25 cycles/px
+    float anisotropy = 0;
+    float dominantOrientation = 0;      // degrees
+    std::shared_ptr<image_buffer<half, 1>> thumbnail;  // centered log magnitude in [0, 1], fp16 to halve the gallery
+};
+
+// Spectral summary of one image; only the thumbnail outlives the call
+inline layer_spectrum analyze_layer(image_buffer<float, 1> & img, const int thumbnailSize)
+{
+    layer_spectrum result;
+    result.mean = img.compute_mean();
+
+    std::vector<std::complex<float>> spectrum = compute_spectrum(img);
+
+    const int width = img.size.x, height = img.size.y;
+    const spectrum_statistics stats = compute_spectrum_statistics(spectrum.data(), img.size);
+    result.spectralCentroid = stats.spectralCentroid;
+    result.highFrequencyFraction = stats.highFrequencyFraction;
+    result.anisotropy = stats.anisotropy;
+    result.dominantOrientation = stats.dominantOrientation;
+
+    image_buffer<float, 1> logMagnitude(img.size);
+    for (int i = 0; i < logMagnitude.num_pixels(); ++i) logMagnitude.alias[i] = std::log1p(std::abs(spectrum[i]));
+
+    const float maxLog = reduce_samples(logMagnitude.alias, logMagnitude.num_pixels()).max;
+    if (maxLog > 0) for (int i = 0; i < logMagnitude.num_pixels(); ++i) logMagnitude.alias[i] /= maxLog;
+
+    image_buffer<float, 1> centered(img.size);
+    center_fft_image(logMagnitude, centered);
+    const int factor = std::max(1, std::max(width, height) / thumbnailSize);
+    result.thumbnail = std::make_shared<image_buffer<half, 1>>(convert_image<half>(downsample_box(centered.view(), factor)));
+    return result;
+}
+
+// Analyzes mip 0 of every layer and face as an independent job on the shared pool. Layers are decoded from the
+// container's views one at a time per worker, so peak memory is bounded by the worker count, not the array size.
+inline std::vector<layer_spectrum> analyze_texture_layers(const texture_container & t, const int thumbnailSize = 128)
+{
+    const int numImages = t.layers * t.faces;
+    std::vector<layer_spectrum> results(numImages);
+
+    parallel_for(0, numImages, 1, [&](int b, int e)
+    {
+        for (int i = b; i < e; ++i)
+        {
+            const int layer = i / t.faces, face = i % t.faces;
+            auto img = texture_to_luminance(t.view(layer, face, 0));
+            results[i] = analyze_layer(img, thumbnailSize);
+            results[i].layer = layer;
+            results[i].face = face;
+        }
+    });
+
+    return results;
+}
+
+// Lays the layer thumbnails out in a near-square grid, row-major in (layer, face) order
+inline image_buffer<float, 1> tile_layer_thumbnails(const std::vector<layer_spectrum> & layers, int & columns)
+{
+    if (layers.empty()) throw std::runtime_error("no layers to tile");
+
+    const int2 tile = layers[0].thumbnail->size;
+    columns = (int)std::ceil(std::sqrt((float)layers.size()));
+    const int rows = ((int)layers.size() + columns - 1) / columns;
+
+    image_buffer<float, 1> overview({ columns * tile.x, rows * tile.y });
+    std::fill(overview.alias, overview.alias + overview.num_pixels(), 0.f);
+
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        image_buffer<half, 1> & thumb = *layers[i].thumbnail;
+        const int ox = int(i % columns) * tile.x, oy = int(i / columns) * tile.y;
+        for (int y = 0; y < std::min(tile.y, thumb.size.y); ++y)
+            for (int x = 0; x < std::min(tile.x, thumb.size.x); ++x)
+                overview(oy + y, ox + x) = half_to_float(thumb(y, x));
+    }
+    return overview;
+}
+
+////////////////////////
+//   Volume Spectra   //
+////////////////////////
+
+struct volume_spectrum
+{
+    // Centered log magnitude through the DC voxel, each normalized to [0, 1]
+    std::shared_ptr<image_buffer<float, 1>> sliceXY, sliceXZ, sliceYZ;
+    std::vector<float> radialPower; // mean power per shell, bin i covers radii [i, i + 1) * 0.5 / bins cycles/voxel
+};
+
+inline std::shared_ptr<image_buffer<float, 1>> make_spectrum_slice(const int2 size, const std::function<std::complex<float>(int, int)> & sample)
+{
+    image_buffer<float, 1> slice(size);
+    for (int y = 0; y < size.y; ++y)
+        for (int x = 0; x < size.x; ++x) slice(y, x) = std::log1p(std::abs(sample(y, x)));
+
+    const float maxLog = reduce_samples(slice.alias, slice.num_pixels()).max;
+    if (maxLog > 0) for (int i = 0; i < slice.num_pixels(); ++i) slice.alias[i] /= maxLog;
+
+    auto centered = std::make_shared<image_buffer<float, 1>>(size);
+    center_fft_image(slice, *centered);
+    return centered;
+}
+
+inline volume_spectrum analyze_volume(const std::vector<float> & voxels, const int3 & size)
+{
+    const int width = size.x, height = size.y, depth = size.z;
+    const size_t sliceSize = size_t(width) * height;
+
+    const double mean = reduce_samples(voxels.data(), voxels.size()).mean;
+
+    std::vector<std::complex<float>> spectrum(voxels.size());
+    for (size_t i = 0; i < voxels.size(); ++i) spectrum[i] = float(voxels[i] - mean);
+    compute_fft_3d(spectrum.data(), size);
+
+    // Radial shells, with one histogram per chunk of z merged at the end
+    const int numBins = std::max(1, std::max(width, std::max(height, depth)) / 2);
+    struct shell_histogram { std::vector<double> power; std::vector<uint64_t> count; };
+    std::vector<shell_histogram> partials(depth);
+
+    parallel_for(0, depth, 1, [&](int z0, int z1)
+    {
+        shell_histogram & h = partials[z0];
+        h.power.assign(numBins, 0.0);
+        h.count.assign(numBins, 0);
+
+        for (int z = z0; z < z1; ++z)
+        {
+            const float rw = float(signed_frequency(z, depth)) / depth;
+            for (int y = 0; y < height; ++y)
+            {
+                const float rv = float(signed_frequency(y, height)) / height;
+                for (int x = 0; x < width; ++x)
+                {
+                    const float ru = float(signed_frequency(x, width)) / width;
+                    const int bin = int(std::sqrt(ru * ru + rv * rv + rw * rw) * 2.f * numBins);
+                    if (bin >= numBins) continue;
+                    h.power[bin] += std::norm(spectrum[z * sliceSize + size_t(y) * width + x]);
+                    h.count[bin]++;
+                }
+            }
+        }
+    });
+
+    volume_spectrum result;
+    result.radialPower.assign(numBins, 0.f);
+    for (int i = 0; i < numBins; ++i)
+    {
+        double power = 0;
+        uint64_t count = 0;
+        for (auto & h : partials)
+        {
+            if (h.power.empty()) continue;
+            power += h.power[i];
+            count += h.count[i];
+        }
+        result.radialPower[i] = count ? float(power / count) : 0.f;
+    }
+
+    auto at = [&](int x, int y, int z) { return spectrum[z * sliceSize + size_t(y) * width + x]; };
+    result.sliceXY = make_spectrum_slice({ width, height }, [&](int y, int x) { return at(x, y, 0); });
+    result.sliceXZ = make_spectrum_slice({ width, depth }, [&](int z, int x) { return at(x, 0, z); });
+    result.sliceYZ = make_spectrum_slice({ height, depth }, [&](int z, int y) { return at(0, y, z); });
+    return result;
+}
+
+#endif // end spectrum_hpp
@@ -0,0 +1,243 @@
+#ifndef texture_container_hpp
+#define texture_container_hpp
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include "util.hpp"
+#include "png_decode.hpp"
+
+//////////////////////////////
+//   Container Detection    //
+//////////////////////////////
+
+enum class container_format { unknown, png, hdr, dds, ktx, kmg };
+
+// Identifies a file by its leading magic bytes rather than its extension
+inline container_format detect_container(const uint8_t * data, const size_t size)
+{
+    auto starts_with = [&](const void * magic, const size_t n) { return size >= n && std::memcmp(data, magic, n) == 0; };
+
+    if (png_has_signature(data, size)) return container_format::png;
+    if (starts_with("#?RADIANCE", 10) || starts_with("#?RGBE", 6)) return container_format::hdr;
+    if (starts_with(gli::detail::FOURCC_DDS, sizeof(gli::detail::FOURCC_DDS))) return container_format::dds;
+    if (starts_with(gli::detail::FOURCC_KTX10, sizeof(gli::detail::FOURCC_KTX10))) return container_format::ktx;
+    if (starts_with(gli::detail::FOURCC_KMG100, sizeof(gli::detail::FOURCC_KMG100))) return container_format::kmg;
+    return container_format::unknown;
+}
+
+///////////////////////////
+//   Texture Container   //
+///////////////////////////
+
+// One image of a texture: a single (layer, face, level). The data pointer aliases the container's memory.
+struct texture_level_view
+{
+    gli::format format;
+    int3 extent;
+    const void * data;
+    size_t size;
+};
+
+// A dds, ktx or kmg parsed in place. Headers are decoded with gli's own tables, but unlike gli::load the image
+// data is never copied: every (layer, face, level) is a view into the source memory, which is usually a mapped_file.
+class texture_container
+{
+    std::shared_ptr<const mapped_file> backing;
+    std::vector<size_t> offsets; // [(layer * faces + face) * levels + level]
+    const uint8_t * base = nullptr;
+    size_t baseSize = 0;
+
+    static bool is_known_format(const gli::format f)
+    {
+        return f >= gli::FORMAT_FIRST && f <= gli::FORMAT_LAST;
+    }
+
+    void compute_offsets(size_t offset, const container_format container)
+    {
+        offsets.assign(size_t(layers) * faces * levels, 0);
+
+        auto place = [&](int layer, int face, int level)
+        {
+            if (offset + level_size(level) > baseSize) throw std::runtime_error("truncated texture file");
+            offsets[(size_t(layer) * faces + face) * levels + level] = offset;
+        };
+
+        switch (container)
+        {
+        case container_format::dds:
+            for (int layer = 0; layer < layers; ++layer)
+                for (int face = 0; face < faces; ++face)
+                    for (int level = 0; level < levels; ++level) { place(layer, face, level); offset += level_size(level); }
+            break;
+        case container_format::ktx:
+            for (int level = 0; level < levels; ++level)
+            {
+                offset += sizeof(uint32_t); // imageSize
+                for (int layer = 0; layer < layers; ++layer)
+                    for (int face = 0; face < faces; ++face)
+                    {
+                        place(layer, face, level);
+                        offset += std::max(gli::block_size(format), (level_size(level) + 3) & ~size_t(3)); // cube padding
+                    }
+            }
+            break;
+        case container_format::kmg:
+            for (int layer = 0; layer < layers; ++layer)
+                for (int level = 0; level < levels; ++level)
+                    for (int face = 0; face < faces; ++face) { place(layer, face, level); offset += level_size(level); }
+            break;
+        default: break;
+        }
+    }
+
+    void parse_dds(const uint8_t * data, const size_t size)
+    {
+        using namespace gli::detail;
+
+        size_t offset = sizeof(FOURCC_DDS);
+        if (size < offset + sizeof(dds_header)) throw std::runtime_error("truncated dds header");
+        dds_header header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        offset += sizeof(dds_header);
+
+        dds_header10 header10;
+        const bool hasHeader10 = (header.Format.flags & gli::dx::DDPF_FOURCC) && (header.Format.fourCC == gli::dx::D3DFMT_DX10 || header.Format.fourCC == gli::dx::D3DFMT_GLI1);
+        if (hasHeader10)
+        {
+            if (size < offset + sizeof(header10)) throw std::runtime_error("truncated dds header");
+            std::memcpy(&header10, data + offset, sizeof(header10));
+            offset += sizeof(dds_header10);
+        }
+
+        gli::dx dx;
+        format = gli::FORMAT_UNDEFINED;
+        if ((header.Format.flags & (gli::dx::DDPF_RGB | gli::dx::DDPF_ALPHAPIXELS | gli::dx::DDPF_ALPHA | gli::dx::DDPF_YUV | gli::dx::DDPF_LUMINANCE)) && header.Format.bpp != 0)
+        {
+            // Legacy uncompressed layouts are identified by their channel masks, in the same order gli::load_dds tests them
+            static const gli::format candidates[] =
+            {
+                gli::FORMAT_RG4_UNORM_PACK8, gli::FORMAT_L8_UNORM_PACK8, gli::FORMAT_A8_UNORM_PACK8, gli::FORMAT_R8_UNORM_PACK8, gli::FORMAT_RG3B2_UNORM_PACK8,
+                gli::FORMAT_RGBA4_UNORM_PACK16, gli::FORMAT_BGRA4_UNORM_PACK16, gli::FORMAT_R5G6B5_UNORM_PACK16, gli::FORMAT_B5G6R5_UNORM_PACK16,
+                gli::FORMAT_RGB5A1_UNORM_PACK16, gli::FORMAT_BGR5A1_UNORM_PACK16, gli::FORMAT_LA8_UNORM_PACK8, gli::FORMAT_RG8_UNORM_PACK8,
+                gli::FORMAT_L16_UNORM_PACK16, gli::FORMAT_A16_UNORM_PACK16, gli::FORMAT_R16_UNORM_PACK16,
+                gli::FORMAT_RGB8_UNORM_PACK8, gli::FORMAT_BGR8_UNORM_PACK8,
+                gli::FORMAT_BGR8_UNORM_PACK32, gli::FORMAT_BGRA8_UNORM_PACK8, gli::FORMAT_RGBA8_UNORM_PACK8, gli::FORMAT_RGB10A2_UNORM_PACK32,
+                gli::FORMAT_LA16_UNORM_PACK16, gli::FORMAT_RG16_UNORM_PACK16, gli::FORMAT_R32_SFLOAT_PACK32
+            };
+            for (auto candidate : candidates)
+            {
+                if (gli::block_size(candidate) * 8 == header.Format.bpp && glm::all(glm::equal(header.Format.Mask, dx.translate(candidate).Mask)))
+                {
+                    format = candidate;
+                    break;
+                }
+            }
+        }
+        else if ((header.Format.flags & gli::dx::DDPF_FOURCC) && !hasHeader10) format = dx.find(remap_four_cc(header.Format.fourCC));
+        else if (hasHeader10) format = dx.find(header.Format.fourCC, header10.Format);
+
+        if (!is_known_format(format)) throw std::runtime_error("unsupported dds format");
+
+        target = get_target(header, header10);
+        extent = { int(header.Width), int(std::max(header.Height, 1u)), int((header.CubemapFlags & DDSCAPS2_VOLUME) ? std::max(header.Depth, 1u) : 1u) };
+        layers = int(std::max(header10.ArraySize, 1u));
+        faces = (header.CubemapFlags & DDSCAPS2_CUBEMAP) ? int(glm::bitCount(header.CubemapFlags & DDSCAPS2_CUBEMAP_ALLFACES)) : 1;
+        levels = (header.Flags & DDSD_MIPMAPCOUNT) ? int(std::max(header.MipMapLevels, 1u)) : 1;
+
+        compute_offsets(offset, container_format::dds);
+    }
+
+    void parse_ktx(const uint8_t * data, const size_t size)
+    {
+        using namespace gli::detail;
+
+        size_t offset = sizeof(FOURCC_KTX10);
+        if (size < offset + sizeof(ktx_header10)) throw std::runtime_error("truncated ktx header");
+        ktx_header10 header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        offset += sizeof(ktx_header10) + header.BytesOfKeyValueData;
+
+        if (header.Endianness != 0x04030201) throw std::runtime_error("big-endian ktx not supported");
+
+        gli::gl gl(gli::gl::PROFILE_KTX);
+        format = gl.find(static_cast<gli::gl::internal_format>(header.GLInternalFormat), static_cast<gli::gl::external_format>(header.GLFormat), static_cast<gli::gl::type_format>(header.GLType));
+        if (!is_known_format(format)) throw std::runtime_error("unsupported ktx format");
+
+        target = get_target(header);
+        extent = { int(header.PixelWidth), int(std::max(header.PixelHeight, 1u)), int(std::max(header.PixelDepth, 1u)) };
+        layers = int(std::max(header.NumberOfArrayElements, 1u));
+        faces = int(std::max(header.NumberOfFaces, 1u));
+        levels = int(std::max(header.NumberOfMipmapLevels, 1u));
+
+        compute_offsets(offset, container_format::ktx);
+    }
+
+    void parse_kmg(const uint8_t * data, const size_t size)
+    {
+        using namespace gli::detail;
+
+        size_t offset = sizeof(FOURCC_KMG100);
+        if (size < offset + sizeof(kmgHeader10)) throw std::runtime_error("truncated kmg header");
+        kmgHeader10 header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        offset += sizeof(kmgHeader10);
+
+        format = static_cast<gli::format>(header.Format);
+        if (!is_known_format(format)) throw std::runtime_error("unsupported kmg format");
+        target = static_cast<gli::target>(header.Target);
+        swizzles = gli::swizzles(gli::swizzle(header.SwizzleRed), gli::swizzle(header.SwizzleGreen), gli::swizzle(header.SwizzleBlue), gli::swizzle(header.SwizzleAlpha));
+        extent = { int(header.PixelWidth), int(std::max(header.PixelHeight, 1u)), int(std::max(header.PixelDepth, 1u)) };
+        layers = int(std::max(header.Layers, 1u));
+        faces = int(std::max(header.Faces, 1u));
+        levels = int(std::max(header.Levels, 1u));
+
+        compute_offsets(offset, container_format::kmg);
+    }
+
+public:
+
+    gli::target target = gli::TARGET_2D;
+    gli::format format = gli::FORMAT_UNDEFINED;
+    gli::swizzles swizzles = gli::swizzles(gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA);
+    int3 extent = { 0, 0, 0 };
+    int layers = 0, faces = 0, levels = 0;
+
+    // Parses the header of the mapped file; the mapping stays alive as long as the container does
+    texture_container(std::shared_ptr<const mapped_file> file) : backing(file)
+    {
+        base = backing->data();
+        baseSize = backing->size();
+
+        switch (detect_container(base, baseSize))
+        {
+        case container_format::dds: parse_dds(base, baseSize); break;
+        case container_format::ktx: parse_ktx(base, baseSize); break;
+        case container_format::kmg: parse_kmg(base, baseSize); break;
+        default: throw std::runtime_error("not a dds, ktx or kmg file");
+        }
+    }
+
+    int3 level_extent(const int level) const
+    {
+        return { std::max(1, extent.x >> level), std::max(1, extent.y >> level), std::max(1, extent.z >> level) };
+    }
+
+    size_t level_size(const int level) const
+    {
+        const int3 e = level_extent(level);
+        const gli::ivec3 block = gli::block_extent(format);
+        const size_t blocks = size_t((e.x + block.x - 1) / block.x) * ((e.y + block.y - 1) / block.y) * ((e.z + block.z - 1) / block.z);
+        return blocks * gli::block_size(format);
+    }
+
+    texture_level_view view(const int layer, const int face, const int level) const
+    {
+        if (layer >= layers || face >= faces || level >= levels) throw std::runtime_error("texture view out of range");
+        return { format, level_extent(level), base + offsets[(size_t(layer) * faces + face) * levels + level], level_size(level) };
+    }
+};
+
+#endif // end texture_container_hpp
@@ -3,6 +3,7 @@
 #include <complex>
 #include <utility>
 #include <vector>
+#include <memory>
 
 template <typename scalar_t>
 class kissfft
@@ -11,17 +12,34 @@ public:
 
     using cpx_t = std::complex<scalar_t>;
 
+    using twiddle_table = std::vector<cpx_t>;
+
+    /// Forward twiddle factors exp(-2 pi i k / nfft), generated in double whatever scalar_t is so
+    /// float plans stay accurate at large N. Inverse plans read the same table conjugated, so one
+    /// table can be shared by every plan of a size in either direction.
+    static std::shared_ptr<const twiddle_table> make_twiddles(const std::size_t nfft)
+    {
+        auto twiddles = std::make_shared<twiddle_table>(nfft);
+        const double phinc = -2 * acos(-1.0) / nfft;
+        for (std::size_t i = 0; i<nfft; ++i)
+            (*twiddles)[i] = cpx_t(std::polar(1.0, i*phinc));
+        return twiddles;
+    }
+
     kissfft(const std::size_t nfft,
         const bool inverse)
-        :_nfft(nfft)
-        , _inverse(inverse)
+        : kissfft(make_twiddles(nfft), inverse)
     {
-        // fill twiddle factors
-        _twiddles.resize(_nfft);
-        const scalar_t phinc = (_inverse ? 2 : -2)* acos((scalar_t)-1) / _nfft;
-        for (std::size_t i = 0; i<_nfft; ++i)
-            _twiddles[i] = exp(cpx_t(0, i*phinc));
+    }
 
+    /// Plan reading a shared forward twiddle table of the transform length
+    kissfft(const std::shared_ptr<const twiddle_table> & twiddles,
+        const bool inverse)
+        :_nfft(twiddles->size())
+        , _inverse(inverse)
+        , _twiddle_sign(inverse ? -1 : 1)
+        , _twiddles(twiddles)
+    {
         //factorize
         //start factoring out 4's, then 2's, then 3,5,7,9,...
         std::size_t n = _nfft;
@@ -59,10 +77,9 @@ public:
         }
         else if (inverse != _inverse)
         {
-            // conjugate the twiddle factors.
-            for (typename std::vector<cpx_t>::iterator it = _twiddles.begin();
-                it != _twiddles.end(); ++it)
-                it->imag(-it->imag());
+            // the table is shared and always forward; only the sign it is read with changes
+            _inverse = inverse;
+            _twiddle_sign = inverse ? -1 : 1;
         }
     }
 
@@ -169,12 +186,12 @@ public:
             const cpx_t z = (scalar_t)0.5 * cpx_t(
                 dst[k].imag() + dst[N - k].imag(),
                 -dst[k].real() + dst[N - k].real());
-            const cpx_t twiddle =
+            const cpx_t tw =
                 k % 2 == 0 ?
-                _twiddles[k / 2] :
-                _twiddles[k / 2] * twiddle_mul;
-            dst[k] = w + twiddle * z;
-            dst[N - k] = conj(w - twiddle * z);
+                twiddle(k / 2) :
+                twiddle(k / 2) * twiddle_mul;
+            dst[k] = w + tw * z;
+            dst[N - k] = conj(w - tw * z);
         }
         if (N % 2 == 0)
             dst[N / 2] = conj(dst[N / 2]);
@@ -182,10 +199,16 @@ public:
 
 private:
 
+    cpx_t twiddle(const std::size_t i) const
+    {
+        const cpx_t & t = (*_twiddles)[i];
+        return cpx_t(t.real(), _twiddle_sign * t.imag());
+    }
+
     void kf_bfly2(cpx_t * Fout, const size_t fstride, const std::size_t m) const
     {
         for (std::size_t k = 0; k<m; ++k) {
-            const cpx_t t = Fout[m + k] * _twiddles[k*fstride];
+            const cpx_t t = Fout[m + k] * twiddle(k*fstride);
             Fout[m + k] = Fout[k] - t;
             Fout[k] += t;
         }
@@ -195,15 +218,13 @@ private:
     {
         std::size_t k = m;
         const std::size_t m2 = 2 * m;
-        const cpx_t *tw1, *tw2;
+        std::size_t tw1 = 0, tw2 = 0;
         cpx_t scratch[5];
-        const cpx_t epi3 = _twiddles[fstride*m];
-
-        tw1 = tw2 = &_twiddles[0];
+        const cpx_t epi3 = twiddle(fstride*m);
 
         do {
-            scratch[1] = Fout[m] * *tw1;
-            scratch[2] = Fout[m2] * *tw2;
+            scratch[1] = Fout[m] * twiddle(tw1);
+            scratch[2] = Fout[m2] * twiddle(tw2);
 
             scratch[3] = scratch[1] + scratch[2];
             scratch[0] = scratch[1] - scratch[2];
@@ -227,9 +248,9 @@ private:
         cpx_t scratch[7];
         const scalar_t negative_if_inverse = _inverse ? -1 : +1;
         for (std::size_t k = 0; k<m; ++k) {
-            scratch[0] = Fout[k + m] * _twiddles[k*fstride];
-            scratch[1] = Fout[k + 2 * m] * _twiddles[k*fstride * 2];
-            scratch[2] = Fout[k + 3 * m] * _twiddles[k*fstride * 3];
+            scratch[0] = Fout[k + m] * twiddle(k*fstride);
+            scratch[1] = Fout[k + 2 * m] * twiddle(k*fstride * 2);
+            scratch[2] = Fout[k + 3 * m] * twiddle(k*fstride * 3);
             scratch[5] = Fout[k] - scratch[1];
 
             Fout[k] += scratch[1];
@@ -249,8 +270,8 @@ private:
     {
         cpx_t *Fout0, *Fout1, *Fout2, *Fout3, *Fout4;
         cpx_t scratch[13];
-        const cpx_t ya = _twiddles[fstride*m];
-        const cpx_t yb = _twiddles[fstride * 2 * m];
+        const cpx_t ya = twiddle(fstride*m);
+        const cpx_t yb = twiddle(fstride * 2 * m);
 
         Fout0 = Fout;
         Fout1 = Fout0 + m;
@@ -261,10 +282,10 @@ private:
         for (std::size_t u = 0; u<m; ++u) {
             scratch[0] = *Fout0;
 
-            scratch[1] = *Fout1 * _twiddles[u*fstride];
-            scratch[2] = *Fout2 * _twiddles[2 * u*fstride];
-            scratch[3] = *Fout3 * _twiddles[3 * u*fstride];
-            scratch[4] = *Fout4 * _twiddles[4 * u*fstride];
+            scratch[1] = *Fout1 * twiddle(u*fstride);
+            scratch[2] = *Fout2 * twiddle(2 * u*fstride);
+            scratch[3] = *Fout3 * twiddle(3 * u*fstride);
+            scratch[4] = *Fout4 * twiddle(4 * u*fstride);
 
             scratch[7] = scratch[1] + scratch[4];
             scratch[10] = scratch[1] - scratch[4];
@@ -317,7 +338,6 @@ private:
         const std::size_t p
     ) const
     {
-        const cpx_t * twiddles = &_twiddles[0];
         cpx_t *  scratchbuf = new cpx_t[p];
 
         for (std::size_t u = 0; u<m; ++u) {
@@ -335,17 +355,18 @@ private:
                     twidx += fstride * k;
                     if (twidx >= _nfft)
                         twidx -= _nfft;
-                    Fout[k] += scratchbuf[q] * twiddles[twidx];
+                    Fout[k] += scratchbuf[q] * twiddle(twidx);
                 }
                 k += m;
             }
         }
-        delete scratchbuf;
+        delete[] scratchbuf;
     }
 
     std::size_t _nfft;
     bool _inverse;
-    std::vector<cpx_t> _twiddles;
+    scalar_t _twiddle_sign;
+    std::shared_ptr<const twiddle_table> _twiddles;
     std::vector<std::size_t> _stageRadix;
     std::vector<std::size_t> _stageRemainder;
 };
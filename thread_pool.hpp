@@ -0,0 +1,397 @@
+#ifndef thread_pool_hpp
+#define thread_pool_hpp
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+//////////////////////
+//   Cancellation   //
+//////////////////////
+
+// Shared flag checked by jobs between units of work. Copies refer to the same flag, so cancelling any copy
+// cancels the work started with all of them. Jobs already running finish their current unit.
+class cancellation_token
+{
+    std::shared_ptr<std::atomic<bool>> flag = std::make_shared<std::atomic<bool>>(false);
+
+public:
+
+    void cancel() const { *flag = true; }
+    bool cancelled() const { return *flag; }
+};
+
+/////////////////////
+//   Thread Pool   //
+/////////////////////
+
+// Fixed set of workers shared by the whole application. Each worker owns a deque: jobs submitted from a worker
+// go to the back of its own deque and it takes them back newest first, while idle workers steal the oldest job
+// from the front of the others'. Jobs from outside the pool are dealt round-robin across the deques.
+// Every blocking call (parallel_for, task::wait, task_graph::run) runs queued jobs while it waits, so they are
+// safe to nest from inside a job and make progress even when the pool has no workers at all.
+class thread_pool
+{
+    enum : int { job_pending, job_running, job_done };
+
+    struct job
+    {
+        std::function<void()> fn;
+        std::atomic<int> status{ job_pending };
+        std::exception_ptr error;
+    };
+
+    struct job_queue
+    {
+        std::deque<std::shared_ptr<job>> jobs;
+        std::mutex mutex;
+    };
+
+    struct worker_identity
+    {
+        const thread_pool * pool = nullptr;
+        size_t index = 0;
+    };
+
+    static worker_identity & this_worker()
+    {
+        static thread_local worker_identity identity;
+        return identity;
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<job_queue>> queues; // one per worker, or a single one when there are no workers
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<size_t> nextQueue{ 0 };
+    std::atomic<int> waiting{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void push(std::shared_ptr<job> j)
+    {
+        const worker_identity & self = this_worker();
+        const size_t q = self.pool == this ? self.index : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            ++queued; // counted before it can be taken, so the count never drops below zero
+            queues[q]->jobs.push_back(std::move(j));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Own deque from the back first, then the others from the front
+    std::shared_ptr<job> pop()
+    {
+        const worker_identity & self = this_worker();
+        const bool isWorker = self.pool == this;
+        const size_t first = isWorker ? self.index : 0;
+
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            job_queue & q = *queues[(first + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.jobs.empty()) continue;
+
+            std::shared_ptr<job> j;
+            if (isWorker && i == 0) { j = std::move(q.jobs.back()); q.jobs.pop_back(); }
+            else { j = std::move(q.jobs.front()); q.jobs.pop_front(); }
+            --queued;
+            return j;
+        }
+        return nullptr;
+    }
+
+    // A job may already have been claimed by a thread waiting on it, in which case its queue entry does nothing
+    void execute(job & j)
+    {
+        int expected = job_pending;
+        if (!j.status.compare_exchange_strong(expected, job_running)) return;
+
+        try { j.fn(); }
+        catch (...) { j.error = std::current_exception(); }
+        j.fn = nullptr;
+        j.status = job_done;
+
+        if (waiting > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+        }
+    }
+
+    bool run_one()
+    {
+        std::shared_ptr<job> j = pop();
+        if (!j) return false;
+        execute(*j);
+        return true;
+    }
+
+    void worker_loop(const size_t index)
+    {
+        this_worker().pool = this;
+        this_worker().index = index;
+
+        for (;;)
+        {
+            if (run_one()) continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+        }
+    }
+
+public:
+
+    // Handle to a job started with async(). Like a future from std::async, a handle destroyed before wait()
+    // waits for the job (discarding its exception), so jobs may refer to the locals of the scope that started them.
+    class task
+    {
+        friend class thread_pool;
+        thread_pool * pool = nullptr;
+        std::shared_ptr<job> state;
+
+        void finish() { try { wait(); } catch (...) {} }
+
+    public:
+
+        task() = default;
+        task(task && r) : pool(r.pool), state(std::move(r.state)) {}
+        task & operator = (task && r) { if (this != &r) { finish(); pool = r.pool; state = std::move(r.state); } return *this; }
+        ~task() { finish(); }
+
+        bool valid() const { return state != nullptr; }
+
+        // Runs the job on the calling thread if no worker has started it yet, otherwise helps with other jobs
+        // until it is done. Rethrows an exception thrown by the job.
+        void wait()
+        {
+            if (!state) return;
+            pool->execute(*state);
+            pool->wait_until([this] { return state->status == job_done; });
+            std::exception_ptr error = state->error;
+            state.reset();
+            if (error) std::rethrow_exception(error);
+        }
+    };
+
+    thread_pool(const size_t numThreads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        // The calling thread always helps out, so spawn one less worker than requested
+        const size_t numWorkers = std::max<size_t>(numThreads, 1) - 1;
+        for (size_t i = 0; i < std::max<size_t>(numWorkers, 1); ++i) queues.emplace_back(new job_queue());
+        for (size_t i = 0; i < numWorkers; ++i) workers.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto & w : workers) w.join();
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool & operator = (const thread_pool &) = delete;
+
+    size_t num_threads() const { return workers.size() + 1; }
+
+    // Fire and forget: the job runs on whichever thread picks it up, a worker or a thread waiting in the pool
+    void enqueue(std::function<void()> fn)
+    {
+        std::shared_ptr<job> j = std::make_shared<job>();
+        j->fn = std::move(fn);
+        push(std::move(j));
+    }
+
+    task async(std::function<void()> fn)
+    {
+        task t;
+        t.pool = this;
+        t.state = std::make_shared<job>();
+        t.state->fn = std::move(fn);
+        push(t.state);
+        return t;
+    }
+
+    // Runs queued jobs on the calling thread until done() holds. done() must only change as the result of a job
+    // finishing, which is what wakes a waiter that ran out of jobs to help with.
+    void wait_until(const std::function<bool()> & done)
+    {
+        while (!done())
+        {
+            if (run_one()) continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            ++waiting;
+            wake.wait(lock, [&] { return done() || queued > 0; });
+            --waiting;
+        }
+    }
+
+    // Calls fn(begin, end) over [first, last) split into chunks of at most grainSize. Returns once every chunk is done.
+    // Chunks that haven't started when the token is cancelled (or when another chunk throws) are skipped, and the
+    // first exception is rethrown on the calling thread.
+    void parallel_for(const int first, const int last, const int grainSize, const std::function<void(int, int)> & fn, const cancellation_token * token = nullptr)
+    {
+        if (last <= first) return;
+
+        const int grain = std::max(1, grainSize);
+        const int numChunks = (last - first + grain - 1) / grain;
+
+        if (numChunks == 1 || workers.empty())
+        {
+            if (!token || !token->cancelled()) fn(first, last);
+            return;
+        }
+
+        struct shared_state
+        {
+            std::atomic<int> nextChunk{ 0 };
+            std::atomic<int> chunksDone{ 0 };
+            std::atomic<bool> failed{ false };
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+        auto state = std::make_shared<shared_state>();
+
+        auto run_chunks = [state, first, last, grain, numChunks, token, &fn]()
+        {
+            int chunk;
+            while ((chunk = state->nextChunk++) < numChunks)
+            {
+                if (!state->failed && (!token || !token->cancelled()))
+                {
+                    const int b = first + chunk * grain;
+                    try { fn(b, std::min(last, b + grain)); }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (!state->error) state->error = std::current_exception();
+                        state->failed = true;
+                    }
+                }
+                ++state->chunksDone;
+            }
+        };
+
+        // Helpers that start after all chunks are claimed exit immediately without touching fn
+        const size_t numHelpers = std::min<size_t>(workers.size(), numChunks - 1);
+        for (size_t i = 0; i < numHelpers; ++i) enqueue(run_chunks);
+
+        run_chunks();
+        wait_until([&] { return state->chunksDone == numChunks; });
+        if (state->error) std::rethrow_exception(state->error);
+    }
+
+    void parallel_for(const int first, const int last, const int grainSize, const std::function<void(int, int)> & fn, const cancellation_token & token)
+    {
+        parallel_for(first, last, grainSize, fn, &token);
+    }
+};
+
+inline thread_pool & get_thread_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
+
+// Convenience wrapper over the shared pool
+inline void parallel_for(const int first, const int last, const int grainSize, const std::function<void(int, int)> & fn)
+{
+    get_thread_pool().parallel_for(first, last, grainSize, fn);
+}
+
+////////////////////
+//   Task Graph   //
+////////////////////
+
+// Jobs with dependencies on the shared pool. A job is queued as soon as the last job it depends on finishes,
+// so independent branches overlap. Dependencies can only name jobs added earlier, which keeps the graph acyclic.
+class task_graph
+{
+    struct node
+    {
+        std::function<void()> fn;
+        std::vector<size_t> dependents;
+        size_t numDependencies = 0;
+        std::atomic<size_t> remaining{ 0 };
+    };
+
+    std::vector<std::unique_ptr<node>> nodes;
+
+public:
+
+    size_t add(std::function<void()> fn, const std::vector<size_t> & dependencies = {})
+    {
+        const size_t id = nodes.size();
+        std::unique_ptr<node> n(new node());
+        n->fn = std::move(fn);
+        for (size_t d : dependencies)
+        {
+            if (d >= id) throw std::runtime_error("task depends on a task that was added after it");
+            nodes[d]->dependents.push_back(id);
+            n->numDependencies++;
+        }
+        nodes.push_back(std::move(n));
+        return id;
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    // Runs every job once and returns when all are done, helping on the calling thread. Once the token is
+    // cancelled or a job throws, the jobs that haven't started are skipped; the first exception is rethrown.
+    void run(const cancellation_token & token = cancellation_token(), thread_pool & pool = get_thread_pool())
+    {
+        if (nodes.empty()) return;
+        for (auto & n : nodes) n->remaining = n->numDependencies;
+
+        std::atomic<size_t> finished{ 0 };
+        std::atomic<bool> failed{ false };
+        std::mutex mutex;
+        std::exception_ptr error;
+
+        std::function<void(size_t)> schedule = [&](const size_t i)
+        {
+            pool.enqueue([&, i]()
+            {
+                node & n = *nodes[i];
+                if (!failed && !token.cancelled())
+                {
+                    try { n.fn(); }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!error) error = std::current_exception();
+                        failed = true;
+                    }
+                }
+                for (size_t d : n.dependents) if (--nodes[d]->remaining == 0) schedule(d);
+                ++finished;
+            });
+        };
+
+        for (size_t i = 0; i < nodes.size(); ++i) if (nodes[i]->numDependencies == 0) schedule(i);
+        pool.wait_until([&] { return finished == nodes.size(); });
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+#endif // end thread_pool_hpp
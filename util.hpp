@@ -1,6 +1,8 @@
 #ifndef util_hpp
 #define util_hpp
 
+#include <cstring>
+#include <cstdint>
 #include "linalg_util.hpp"
 #include "gli/gli.hpp"
 #include "third-party/stb/stb_image.h"
@@ -14,6 +16,21 @@
 #define GLFW_INCLUDE_GLU
 #include "GLFW\glfw3.h"
 
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 ////////////////////////
 //   Math Utilities   //
 ////////////////////////
@@ -31,6 +48,84 @@ inline float as_float(const T & x)
     return (x - min) / (max - min);
 }
 
+// IEEE 754 binary16, as stored by half-float textures
+struct half { uint16_t bits; };
+
+inline float half_to_float(const half h)
+{
+    const uint32_t sign = uint32_t(h.bits & 0x8000) << 16;
+    uint32_t exponent = (h.bits >> 10) & 0x1f;
+    uint32_t mantissa = h.bits & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0x1f) bits = sign | 0x7f800000 | (mantissa << 13); // inf / nan
+    else if (exponent != 0) bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0) bits = sign;
+    else
+    {
+        // Renormalize a denormal
+        exponent = 113;
+        while (!(mantissa & 0x400)) { mantissa <<= 1; --exponent; }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Round to nearest even, overflowing to infinity and underflowing through the denormals
+inline half float_to_half(const float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) return { uint16_t(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0)) }; // inf / nan
+    if (magnitude >= 0x477ff000) return { uint16_t(sign | 0x7c00) }; // rounds above 65504
+    if (magnitude < 0x33000000) return { sign }; // below half the smallest denormal
+
+    uint32_t h, remainder, halfway;
+    if (magnitude < 0x38800000)
+    {
+        // Denormal: the implicit bit becomes explicit and the mantissa shifts right by the missing exponent
+        const uint32_t shift = 126 - (magnitude >> 23);
+        const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        h = mantissa >> shift;
+        remainder = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        h = (magnitude - 0x38000000) >> 13; // exponent bias 127 -> 15
+        remainder = magnitude & 0x1fff;
+        halfway = 0x1000;
+    }
+    if (remainder > halfway || (remainder == halfway && (h & 1))) ++h; // a carry into the exponent is still correct
+    return { uint16_t(sign | h) };
+}
+
+// The top half of a binary32: float range at 8 bits of precision
+struct bfloat16 { uint16_t bits; };
+
+inline float bfloat16_to_float(const bfloat16 b)
+{
+    const uint32_t bits = uint32_t(b.bits) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline bfloat16 float_to_bfloat16(const float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000) return { uint16_t((bits >> 16) | 0x40) }; // keep nan a nan
+    bits += 0x7fff + ((bits >> 16) & 1); // round to nearest even
+    return { uint16_t(bits >> 16) };
+}
+
 inline bool is_power_of_two(const int & n) 
 {
     return n > 0 && (n & (n - 1)) == 0;
@@ -73,6 +168,165 @@ inline std::vector<uint8_t> read_file_binary(const std::string pathToFile)
     return fileBuffer;
 }
 
+// Read-only view of a whole file through the OS page cache. Nothing is copied until a page is touched.
+class mapped_file
+{
+    const uint8_t * ptr = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+
+    mapped_file(const std::string & pathToFile)
+    {
+#if defined(_WIN32)
+        file = CreateFileA(pathToFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("file not found");
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = size_t(fileSize.QuadPart);
+        if (length < 4) { CloseHandle(file); throw std::runtime_error("error reading file or file too small"); }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) ptr = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!ptr)
+        {
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("couldn't map file");
+        }
+#else
+        const int fd = open(pathToFile.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("file not found");
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < 4) { close(fd); throw std::runtime_error("error reading file or file too small"); }
+        length = size_t(info.st_size);
+        void * addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) throw std::runtime_error("couldn't map file");
+        ptr = static_cast<const uint8_t *>(addr);
+#endif
+    }
+
+    ~mapped_file()
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(ptr);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        munmap(const_cast<uint8_t *>(ptr), length);
+#endif
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator = (const mapped_file &) = delete;
+
+    const uint8_t * data() const { return ptr; }
+    size_t size() const { return length; }
+};
+
+// Read-write scratch file that is only ever accessed through mapped windows, for data that doesn't fit in RAM.
+// The file is removed when closed (or right away on POSIX), so nothing is left behind if the process dies.
+class mapped_scratch_file
+{
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    static size_t granularity()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return size_t(info.dwAllocationGranularity);
+#else
+        return size_t(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+public:
+
+    // A window onto [offset, offset + bytes) of the file, unmapped on destruction. Writes reach the file through
+    // the page cache, so the OS can evict them whenever it needs the memory.
+    class view
+    {
+        uint8_t * base = nullptr;
+        size_t mappedLength = 0, skip = 0;
+
+    public:
+
+        view() = default;
+        view(uint8_t * base, const size_t mappedLength, const size_t skip) : base(base), mappedLength(mappedLength), skip(skip) {}
+        view(view && r) : base(r.base), mappedLength(r.mappedLength), skip(r.skip) { r.base = nullptr; }
+        view & operator = (view && r) { std::swap(base, r.base); std::swap(mappedLength, r.mappedLength); std::swap(skip, r.skip); return *this; }
+        view(const view &) = delete;
+        view & operator = (const view &) = delete;
+
+        ~view()
+        {
+            if (!base) return;
+#if defined(_WIN32)
+            UnmapViewOfFile(base);
+#else
+            munmap(base, mappedLength);
+#endif
+        }
+
+        uint8_t * data() const { return base + skip; }
+    };
+
+    mapped_scratch_file(const std::string & pathToFile, const size_t bytes) : length(bytes)
+    {
+#if defined(_WIN32)
+        file = CreateFileA(pathToFile.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("couldn't create scratch file");
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(uint64_t(bytes) >> 32), DWORD(bytes & 0xffffffff), nullptr);
+        if (!mapping) { CloseHandle(file); throw std::runtime_error("couldn't map scratch file"); }
+#else
+        fd = open(pathToFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) throw std::runtime_error("couldn't create scratch file");
+        unlink(pathToFile.c_str());
+        if (ftruncate(fd, off_t(bytes)) != 0) { close(fd); throw std::runtime_error("couldn't allocate scratch file"); }
+#endif
+    }
+
+    ~mapped_scratch_file()
+    {
+#if defined(_WIN32)
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        close(fd);
+#endif
+    }
+
+    mapped_scratch_file(const mapped_scratch_file &) = delete;
+    mapped_scratch_file & operator = (const mapped_scratch_file &) = delete;
+
+    view map(const size_t offset, const size_t bytes) const
+    {
+        if (offset + bytes > length) throw std::runtime_error("scratch view out of range");
+        const size_t start = offset - offset % granularity(), skip = offset - start;
+#if defined(_WIN32)
+        void * addr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, DWORD(uint64_t(start) >> 32), DWORD(start & 0xffffffff), bytes + skip);
+        if (!addr) throw std::runtime_error("couldn't map scratch view");
+#else
+        void * addr = mmap(nullptr, bytes + skip, PROT_READ | PROT_WRITE, MAP_SHARED, fd, off_t(start));
+        if (addr == MAP_FAILED) throw std::runtime_error("couldn't map scratch view");
+#endif
+        return view(static_cast<uint8_t *>(addr), bytes + skip, skip);
+    }
+
+    size_t size() const { return length; }
+};
+
 ///////////////////////////////////
 //   Windowing & App Lifecycle   //
 ///////////////////////////////////